@@ -137,3 +137,119 @@ border at the top/left/right edges of the screen.
 */
 #define SCROLLW                 38
 #define SCROLLH                 18
+
+/*
+Command types for compiled text layouts; see CompileTextLine().
+*/
+#define TEXT_CMD_GLYPHS         0
+#define TEXT_CMD_CARTOON        1
+#define TEXT_CMD_DELAY          2
+#define TEXT_CMD_PLAYER         3
+#define TEXT_CMD_SPRITE         4
+
+/*
+Streaming (version 2) demo file format. The file begins with the magic and
+version words, followed by a word giving the size in bytes of the header fields
+that follow it. After the header come records. A record that begins with a byte
+below DEMO_TAG_FIRST is a command byte (as packed by WriteDemoFrame()) followed
+by a varint count of the consecutive ticks that used it. Bytes at or above
+DEMO_TAG_FIRST are tags that begin other kinds of records; all of these (except
+DEMO_TAG_END) are followed by a varint size of the data that follows, so that
+readers can skip over any that they don't understand.
+*/
+#define DEMO_STREAM_MAGIC       0xdec0
+#define DEMO_STREAM_VERSION     2
+#define DEMO_TAG_FIRST          0x80
+#define DEMO_TAG_HASH           0x80
+#define DEMO_TAG_START          0x81
+#define DEMO_TAG_CHEAT          0x82
+#define DEMO_TAG_END            0xff
+
+/*
+A spectator relay uses the same records as a demo stream, except that each tick
+sends its own command byte with no count after it. There is no file header;
+instead, a DEMO_TAG_START record holding the same fields as the header is sent
+whenever a game starts or is restored. Each use of a cheat is sent as a
+DEMO_TAG_CHEAT record holding one RELAY_CHEAT_* byte, ahead of the command byte
+of the tick it happened in.
+*/
+#define RELAY_HEADER_SIZE       26
+#define RELAY_CHEAT_ITEMS       0
+#define RELAY_CHEAT_GOD_OFF     1
+#define RELAY_CHEAT_GOD_ON      2
+
+/*
+Agent server protocol. Reset and step commands are followed by one argument byte
+(the level number or the command bits), and are answered with an observation:
+score (low word first), health, and player x and y as words, then a byte of
+AGENT_* flags. Quit has no argument and no answer. With TILE_GRID, the grid
+command has no argument either, and is answered with a tile grid.
+*/
+#define AGENT_CMD_RESET         'R'
+#define AGENT_CMD_STEP          'S'
+#define AGENT_CMD_QUIT          'Q'
+#define AGENT_CMD_GRID          'G'
+#define AGENT_LEVEL_WON         0x01
+#define AGENT_PLAYER_DEAD       0x02
+#define AGENT_GAME_WON          0x04
+
+/*
+Tile grid observations. Each cell is a word: the low byte holds the attributes
+of the map tile there (the same bits that the TILE_* macros test), and the high
+byte holds these bits for what covers the cell.
+*/
+#define GRID_PLAYER             0x0100
+#define GRID_ACTOR              0x0200
+#define GRID_HAZARD             0x0400
+#define GRID_PRIZE              0x0800
+
+/*
+Benchmark workload modes. Simulation runs the game loop without drawing the
+game window, render redraws an unchanging game window, and both is the game
+loop as it normally runs.
+*/
+#define BENCHMARK_SIM           0
+#define BENCHMARK_RENDER        1
+#define BENCHMARK_BOTH          2
+
+/*
+Player movement phases considered by the reachability analyzer. Jumping and
+falling each take several phases, one for every tick of the jump or fall that
+moves the player differently.
+*/
+#define REACH_GROUND            0
+#define REACH_JUMP              1  /* through REACH_JUMP + 7 */
+#define REACH_FALL              9  /* through REACH_FALL + 4 */
+#define REACH_CLING_WEST        14
+#define REACH_CLING_EAST        15
+#define NUM_REACH_PHASES        16
+
+/*
+Virtual clock speeds, in the order that the fast-forward key steps through them.
+*/
+#define CLOCK_NORMAL            0
+#define CLOCK_FAST              1
+#define CLOCK_UNTHROTTLED       2
+#define NUM_CLOCK_SPEEDS        3
+
+/*
+Status bar areas, as bits in the set of areas that need to be redrawn.
+*/
+#define STATUS_SCORE            0x01
+#define STATUS_STARS            0x02
+#define STATUS_BOMBS            0x04
+#define STATUS_HEALTH           0x08
+#define STATUS_ALL              0x0f
+
+/*
+Sprite type properties. SPF_POUNCE marks sprites that react to the player before
+the touch test, usually by being pounced on; SPF_TOUCH marks sprites that react
+when the player is touching them. SPF_HURTS and SPF_PRIZE say what touching them
+can do.
+*/
+#define NUM_SPRITE_TYPES        267
+#define SPF_EXPLODES            0x01
+#define SPF_POUNCE              0x02
+#define SPF_TOUCH               0x04
+#define SPF_HURTS               0x08
+#define SPF_PRIZE               0x10
@@ -74,8 +74,172 @@ Debug mode and demo record/playback variables.
 */
 byte demoState;
 static word demoDataLength, demoDataPos;
+#ifdef DEMO_STREAM
+static FILE *demoStream;
+static byte demoRunCmd;
+static word demoRunLength, demoCommitTicks;
+#endif  /* DEMO_STREAM */
+#ifdef DEMO_DESYNC_CHECK
+static dword demoTick, mapHash;
+static bbool isDesyncReported;
+#endif  /* DEMO_DESYNC_CHECK */
 static bbool isDebugMode = false;
 
+#ifdef HAS_HEADLESS_MODE
+/*
+While this is set, nothing is drawn into the game window. Everything else about
+the game loop carries on as usual.
+*/
+static bbool isRenderSuppressed = false;
+#endif  /* HAS_HEADLESS_MODE */
+
+#ifdef HAS_VIRTUAL_CLOCK
+/*
+Virtual clock state. Each timer interrupt moves the game clock ahead by
+`clockStep` ticks instead of one. While `isClockUnthrottled` is set, nothing
+waits on the game clock at all.
+*/
+static word clockStep = 1;
+bbool isClockUnthrottled = false;
+#ifdef FAST_FORWARD
+static byte clockSpeed = CLOCK_NORMAL;
+#endif  /* FAST_FORWARD */
+#endif  /* HAS_VIRTUAL_CLOCK */
+
+#ifdef BENCHMARK
+/*
+Benchmark state. While a benchmark is running, the game loop is not throttled
+and takes its input from a script. `benchmarkFrames` holds the duration of each
+tick, in ReadPreciseClock() units.
+*/
+static bbool isBenchmarkRunning = false;
+static bbool isBenchmarkTiming;
+static word benchmarkScriptPos, benchmarkScriptLeft;
+static dword benchmarkFrames[BENCHMARK];
+static word numBenchmarkFrames;
+static dword benchmarkLastClock;
+static FILE *benchmarkFp;
+#endif  /* BENCHMARK */
+
+#ifdef TAS_SEARCH
+/*
+Route search state. While a search is running, the game is stepped one tick at
+a time by the search itself.
+*/
+static bbool isSearchRunning = false;
+#endif  /* TAS_SEARCH */
+
+#ifdef HAS_MAP_JOURNAL
+/*
+Once the journal is allocated, map changes are written to it (along with the
+value they replaced) so that the map can be rolled back without keeping a copy
+of the whole thing. Only the first change to each cell since the journal entry
+numbered `mapJournalEpoch` is needed, since rollbacks never stop partway through
+the entries after it. `mapJournalCells` has a bit set for each of those cells.
+*/
+#define MAP_JOURNAL_SIZE 4096
+static struct {
+    word offset, value;
+} *mapJournal = NULL;
+static byte *mapJournalCells = NULL;
+static word mapJournalLength, mapJournalEpoch;
+static bbool isMapJournalFull;
+#endif  /* HAS_MAP_JOURNAL */
+
+#ifdef MAP_CHANGE_LOG
+/*
+Every map cell that changed during the current tick, in the order it happened,
+with its position and its value before and after. Positions are kept as x and y
+because a single offset would wrap on tall maps under MAP_PAGING. Writes that
+store the value a cell already had are left out. If more cells change than fit,
+`isMapChangeLogFull` is set and anything relying on the log has to look at the
+whole map instead.
+*/
+static struct {
+    word x, y, before, after;
+} mapChanges[MAP_CHANGE_LOG];
+static word numMapChanges;
+static bbool isMapChangeLogFull;
+#endif  /* MAP_CHANGE_LOG */
+
+#if defined(DEMO_DESYNC_CHECK) && defined(MAP_CHANGE_LOG)
+/* How many entries at the start of `mapChanges` are counted in `mapHash`. */
+static word numMapChangesHashed;
+#endif  /* DEMO_DESYNC_CHECK && MAP_CHANGE_LOG */
+
+#ifdef LEVEL_RESTART
+/*
+Level restart state. The level image holds what loading the map set up, and
+`levelStart` the episode values that went into the temporary save file then.
+*/
+static byte *levelImage = NULL;
+static bbool isLevelImageValid = false, isLevelRestarting = false;
+static struct {
+    word health, cells, bombs;
+    dword score, stars;
+    bool usedcheat;
+} levelStart;
+#endif  /* LEVEL_RESTART */
+
+#ifdef HAS_TICK_STATICS
+/*
+Static variables of various functions, moved out here so that snapshots can
+include them and so that they can be reset whenever a demo or relay starts.
+They are all game state that carries from one tick to the next.
+*/
+static struct {
+    byte lightningstate;  /* AnimatePalette() */
+    word lastrecoil;  /* TryPounce() */
+    word idlecount, movecount, bombcooldown, bombdir;  /* MovePlayer() */
+    word scooterbombcooldown;  /* MovePlayerScooter() */
+} tickStatics;
+#endif  /* HAS_TICK_STATICS */
+
+#ifdef GOLDEN_TRACE
+/*
+Golden trace state. While demos are being traced, the game loop is not throttled
+and the traced fields are either recorded or checked at the start of each tick.
+`traceDiffField` is WORD_MAX until a traced field differs from the golden trace.
+*/
+static bbool isTraceRunning = false;
+static bbool isTraceRecording, isTraceShort;
+static FILE *traceFp;
+static dword traceTick;
+static dword *traceNow, *traceGolden;
+static word traceDiffField;
+#endif  /* GOLDEN_TRACE */
+
+#ifdef HAS_SERIAL_PORT
+/*
+Serial port state. Bytes to and from the serial port pass through two ring
+buffers; only the serial interrupt moves `relaySendHead` and `relayReceiveTail`,
+and only the game moves the other two.
+*/
+#ifdef SPECTATOR_RELAY
+#   define RELAY_COM     SPECTATOR_RELAY
+#   define RELAY_DIVISOR 12  /* 115,200 / 12 = 9,600 baud */
+#else
+#   define RELAY_COM     AGENT_SERVER
+#   define RELAY_DIVISOR 1  /* 115,200 baud */
+#endif  /* SPECTATOR_RELAY */
+#define RELAY_PORT        (RELAY_COM == 2 ? 0x02f8 : 0x03f8)
+#define RELAY_IRQ         (RELAY_COM == 2 ? 3 : 4)
+#define RELAY_BUFFER_SIZE 256
+static InterruptFunction savedRelayVector;
+static byte relaySendBuffer[RELAY_BUFFER_SIZE], relayReceiveBuffer[RELAY_BUFFER_SIZE];
+static word relaySendHead = 0, relaySendTail = 0;
+static word relayReceiveHead = 0, relayReceiveTail = 0;
+static bbool isRelayPortOpen = false;
+#endif  /* HAS_SERIAL_PORT */
+
+#ifdef SPECTATOR_RELAY
+/*
+While spectating, the game plays back the commands received through the relay
+instead of a demo.
+*/
+static bbool isSpectating = false;
+#endif  /* SPECTATOR_RELAY */
+
 /*
 X any Y move component tables for DIR8_* directions.
 */
@@ -88,7 +252,12 @@ elsewhere in the game.
 */
 word activePage = 0;
 word gameTickCount;
+#ifdef RNG_CONTEXT
+RandomState randomState = {1L, 0, 0};
+#define randStepCount randomState.stepcount
+#else
 static word randStepCount;
+#endif  /* RNG_CONTEXT */
 static dword paletteStepCount;
 
 /*
@@ -155,6 +324,9 @@ static word playerDizzyLeft;
 System variables.
 */
 dword totalMemFreeBefore, totalMemFreeAfter;
+#ifdef MEMORY_ARENAS
+Arena processArena, levelArena;
+#endif  /* MEMORY_ARENAS */
 static InterruptFunction savedInt9;
 static char *writePath;
 
@@ -175,6 +347,13 @@ static Decoration decorations[MAX_DECORATIONS];
 /* Holds each decoration's currently displayed frame. Why this isn't in the Decoration struct, who knows. */
 static word decorationFrame[MAX_DECORATIONS];
 static word backdropTable[BACKDROP_WIDTH * BACKDROP_HEIGHT * 4];
+#ifdef SPRITE_CLIP
+/* In-front flags for each map cell in the game window; see BuildInFrontMask(). */
+static bbool inFrontMask[SCROLLH][SCROLLW];
+static bbool inFrontRows[SCROLLH];  /* row has at least one in-front cell */
+static word inFrontMaskX, inFrontMaskY;
+static bool isInFrontMaskValid;
+#endif  /* SPRITE_CLIP */
 
 /*
 Heap storage areas. Space for all of these is allocated on startup.
@@ -182,8 +361,41 @@ Heap storage areas. Space for all of these is allocated on startup.
 byte *fontTileData, *maskedTileData, *miscData;
 static byte *actorTileData[3], *playerTileData, *tileAttributeData;
 static word *actorInfoData, *playerInfoData, *cartoonInfoData;
+#ifdef CARTOON_CACHE
+static byte *cartoonData = NULL;
+#endif  /* CARTOON_CACHE */
+#ifdef FULLSCREEN_CACHE
+static struct {
+    word image, lastused;
+    byte *data;
+} fullscreenCache[FULLSCREEN_CACHE];
+static word fullscreenCacheClock = 0;
+#endif  /* FULLSCREEN_CACHE */
 static word *soundData1, *soundData2, *soundData3, *soundDataPtr[80];
 static union {byte *b; word *w;} mapData;
+#ifdef MAP_PAGING
+/*
+Paged map state. The map memory holds the window of pages around the game window
+(starting at `mapWindowBase`), then a few slots of single pages that are in use
+somewhere else on the map, like under platforms or actors that keep moving while
+they're out of sight. Right above each of these sits a copy of the map page that
+comes before it, since many callers walk upward from a row address. SetMapTile()
+keeps the copies current.
+*/
+#define MAX_MAP_SLOTS 16
+static FILE *mapSwapFp = NULL;
+static word mapRows, mapWindowY, mapWindowRows;
+static word *mapWindowBase;
+static bool isMapPaged;
+static byte mapPageDirty[(WORD_MAX / MAP_PAGING) + 1];
+static struct {
+    word page;  /* WORD_MAX if the slot is free */
+    dword lastused;
+    word *base;
+} mapSlots[MAX_MAP_SLOTS];
+static word numMapSlots;
+static dword mapSlotClock;
+#endif  /* MAP_PAGING */
 
 /*
 Pass-by-global variables. If you see one of these in use, some earlier function
@@ -202,6 +414,33 @@ bool isJoystickReady;
 bbool cmdWest, cmdEast, cmdNorth, cmdSouth, cmdJump, cmdBomb;
 static bbool blockMovementCmds, cmdJumpLatch;
 static bool blockActionCmds;
+#ifdef INPUT_EVENTS
+#define LATENCY_BUCKETS   16
+#define LATENCY_BUCKET_MS 10
+
+/*
+Key events waiting for the next game tick. Only the keyboard interrupt moves
+`inputEventTail`, and only DrainInputEvents() moves `inputEventHead`.
+*/
+static struct {
+    byte scancode;
+    dword time;
+} inputEvents[INPUT_EVENTS];
+static word inputEventHead = 0, inputEventTail = 0, numDroppedInputEvents = 0;
+static bbool isKeyLatched[BYTE_MAX];
+static bbool isPressPending = false;
+static dword pendingPressTime;
+
+/*
+Set whenever a dialog frame is drawn. The keys pressed while a dialog is up are
+meant for it, so they are thrown away instead of becoming commands.
+*/
+bbool wasDialogShown = false;
+static dword latencyHistogram[LATENCY_BUCKETS];
+#define KEY_ACTIVE(scancode) (isKeyDown[scancode] | isKeyLatched[scancode])
+#else
+#define KEY_ACTIVE(scancode) (isKeyDown[scancode])
+#endif  /* INPUT_EVENTS */
 
 /*
 Customizable options. These are saved and persist across restarts.
@@ -241,8 +480,16 @@ static bbool isPlayerInPipe;
 /*
 Inline functions.
 */
+#ifdef MAP_PAGING
+static word *MapRowAddr(word);
+static void PageInMapWindow(word);
+static void MirrorMapCell(word, word, word);
+#define MAP_CELL_ADDR(x, y)   (MapRowAddr(y) + (x))
+#define MAP_CELL_DATA(x, y)   (*(MapRowAddr(y) + (x)))
+#else
 #define MAP_CELL_ADDR(x, y)   (mapData.w + ((y) << mapYPower) + x)
 #define MAP_CELL_DATA(x, y)   (*(mapData.w + (x) + ((y) << mapYPower)))
+#endif  /* MAP_PAGING */
 #define SET_PLAYER_DIZZY()    { queuePlayerDizzy = true; }
 #define TILE_BLOCK_SOUTH(val) (*(tileAttributeData + ((val) / 8)) & 0x01)
 #define TILE_BLOCK_NORTH(val) (*(tileAttributeData + ((val) / 8)) & 0x02)
@@ -253,8 +500,20 @@ Inline functions.
 #define TILE_SLOPED(val)      (*(tileAttributeData + ((val) / 8)) & 0x40)
 #define TILE_CAN_CLING(val)   (*(tileAttributeData + ((val) / 8)) & 0x80)
 
+#ifdef DEMO_DESYNC_CHECK
+/*
+Contribution of one map cell to `mapHash`. The contributions of all cells are
+summed, so a change to one cell can be applied by swapping its contribution out.
+*/
+#define MAP_CELL_HASH(i, val) ((((dword)(word)((val) * ((i) * 2 + 1))) << 16) + (val) + 1)
+#endif  /* DEMO_DESYNC_CHECK */
+
 /* Duplicate of MAP_CELL_DATA() that takes a shift expression to add to `x`. */
+#ifdef MAP_PAGING
+#define MAP_CELL_DATA_SHIFTED(x, y, shift_expr) (*(MapRowAddr(y) + (x) + shift_expr))
+#else
 #define MAP_CELL_DATA_SHIFTED(x, y, shift_expr) (*(mapData.w + (x) + ((y) << mapYPower) + shift_expr))
+#endif  /* MAP_PAGING */
 
 /*
 Prototypes for "private" functions where strictly required.
@@ -290,6 +549,9 @@ bbool LoadGameState(char);
 byte ProcessGameInput(byte);
 void InitializeLevel(word);
 void InitializeEpisode(void);
+#ifdef SPECTATOR_RELAY
+static void StartRelay(word);
+#endif  /* SPECTATOR_RELAY */
 
 /*
 Get the file size of the named group entry, in bytes.
@@ -334,6 +596,38 @@ static word GameRand(void)
     return randtable[randStepCount] + scrollX + scrollY + randStepCount + playerX + playerY;
 }
 
+#ifdef RNG_CONTEXT
+/*
+Advance `randomState` and return the next number in the range 0..0x7FFF. This
+is the same generator as the Borland C library's rand(), and its initial seed
+is also 1, so the original sequences are preserved.
+*/
+int NextRandom(void)
+{
+    randomState.seed = (randomState.seed * 0x015a4e35L) + 1;
+
+    return (int)(randomState.seed >> 16) & 0x7fff;
+}
+
+/*
+Put every random sequence back to its starting point, with rand()/random()
+starting from `seed` (1 reproduces the sequences of a freshly started game).
+*/
+void SeedRandomState(dword seed)
+{
+    randomState.seed = seed;
+    randomState.stepcount = 0;
+    randomState.shardxmode = 0;
+}
+
+/*
+Everything below uses `randomState` in place of the C library's generator.
+*/
+#undef random
+#define random(num) (NextRandom() % (num))
+#define rand() NextRandom()
+#endif  /* RNG_CONTEXT */
+
 /*
 Read the next color from the palette animation array and load it in.
 */
@@ -355,7 +649,11 @@ Handle palette animation for this frame.
 */
 static void AnimatePalette(void)
 {
+#ifdef HAS_TICK_STATICS
+#   define lightningState tickStatics.lightningstate
+#else
     static byte lightningState = 0;
+#endif  /* HAS_TICK_STATICS */
 
 #ifdef EXPLOSION_PALETTE
     if (paletteAnimationNum == PAL_ANIM_EXPLOSIONS) return;
@@ -428,6 +726,251 @@ static void AnimatePalette(void)
         break;
     }
 }
+#ifdef HAS_TICK_STATICS
+#undef lightningState
+#endif  /* HAS_TICK_STATICS */
+
+#ifdef TEXT_LAYOUT
+#define IS_TEXT_MARKUP(ch) ( \
+    (ch) == '\xFB' || (ch) == '\xFC' || (ch) == '\xFD' || (ch) == '\xFE' \
+)
+
+/*
+Compiled layouts of static text lines, looked up by the address of the text.
+The commands of every kept line share one pool; once that fills up, all of the
+lines are forgotten and the pool starts over.
+*/
+static struct {
+    char *text;
+    word first, count;
+} *keptLayouts = NULL;
+static TextCommand *keptCommands = NULL;
+static word numKeptCommands;
+
+/*
+Read the zero-padded three-digit decimal value of a markup sequence.
+*/
+static word TextMarkupValue(char *text)
+{
+    register word value = 0;
+    register int i;
+
+    for (i = 0; i < 3 && text[i] >= '0' && text[i] <= '9'; i++) {
+        value = (value * 10) + (text[i] - '0');
+    }
+
+    return value;
+}
+
+/*
+Compile the markup in `text` (as described for DrawTextLine()) into `layout`,
+with the first character placed at column `start_col`. Each run of ordinary
+characters becomes one glyph command, and each markup sequence becomes one
+command of its own. The glyph commands point into `text`, so the layout is only
+good for as long as the text is.
+
+Returns a pointer to the first character that didn't fit into the layout, which
+is the terminating null if everything did. Any remainder should be compiled into
+another layout starting at column `layout->endcol`.
+*/
+char *CompileTextLine(char *text, word start_col, TextLayout *layout)
+{
+    register TextCommand *cmd = layout->commands;
+    word col = start_col;
+
+    for (layout->count = 0; *text != '\0' && layout->count < TEXT_LAYOUT_MAX; layout->count++) {
+        cmd->col = col;
+        cmd->text = text;
+
+        switch (*text) {
+        case '\xFB':
+            cmd->type = TEXT_CMD_CARTOON;
+            cmd->arg1 = TextMarkupValue(text + 1);
+            text += 4;
+            break;
+
+        case '\xFC':
+            cmd->type = TEXT_CMD_DELAY;
+            cmd->arg1 = TextMarkupValue(text + 1);
+            text += 4;
+            break;
+
+        case '\xFD':
+            cmd->type = TEXT_CMD_PLAYER;
+            cmd->arg1 = TextMarkupValue(text + 1);
+            text += 4;
+            break;
+
+        case '\xFE':
+            cmd->type = TEXT_CMD_SPRITE;
+            cmd->arg1 = TextMarkupValue(text + 1);
+            cmd->arg2 = TextMarkupValue(text + 4);
+            text += 7;
+            break;
+
+        default:
+            cmd->type = TEXT_CMD_GLYPHS;
+            cmd->arg1 = 0;
+
+            do {
+                cmd->arg1++;
+                text++;
+            } while (*text != '\0' && !IS_TEXT_MARKUP(*text));
+
+            col += cmd->arg1;
+            break;
+        }
+
+        cmd++;
+    }
+
+    layout->endcol = col;
+
+    return text;
+}
+
+/*
+Draw `count` ordinary characters from `text`, starting at x,y, paced by (and
+updating) the typewriter state in `pacing`.
+*/
+static void DrawTextGlyphs(word x, word y, char *text, word count, TextPacing *pacing)
+{
+    for (; count != 0; count--, text++, x++) {
+        while (pacing->delayleft != 0) {
+            if (lastScancode == SCANCODE_SPACE) {
+                WaitHard(1);
+                break;
+            }
+
+            WaitHard(3);
+
+            pacing->delayleft--;
+            if (pacing->delayleft != 0) continue;
+            pacing->delayleft = pacing->delay;
+
+            if (*text != ' ') {
+                StartSound(SND_TEXT_TYPEWRITER);
+            }
+
+            break;
+        }
+
+        if (*text >= 'a') {  /* lowercase */
+            DrawSpriteTile(fontTileData + FONT_LOWER_A + ((*text - 'a') * 40), x, y);
+        } else {  /* uppercase, digits, and symbols */
+            DrawSpriteTile(fontTileData + FONT_UP_ARROW + ((*text - '\x18') * 40), x, y);
+        }
+    }
+}
+
+/*
+Draw `count` compiled text commands, with column zero at the specified X/Y
+origin. `pacing` carries the typewriter delay state.
+*/
+static void DrawTextCommands(
+    word x_origin, word y_origin, TextCommand *cmd, word count, TextPacing *pacing
+) {
+    word i;
+
+    EGA_MODE_DEFAULT();
+
+    for (i = 0; i < count; i++, cmd++) {
+        switch (cmd->type) {
+        case TEXT_CMD_CARTOON:
+            DrawCartoon(cmd->arg1, x_origin + cmd->col, y_origin);
+            break;
+
+        case TEXT_CMD_DELAY:
+            pacing->delayleft = pacing->delay = cmd->arg1;
+            break;
+
+        case TEXT_CMD_PLAYER:
+            DrawPlayer(cmd->arg1, x_origin + cmd->col, y_origin, DRAW_MODE_ABSOLUTE);
+            break;
+
+        case TEXT_CMD_SPRITE:
+            DrawSprite(cmd->arg1, cmd->arg2, x_origin + cmd->col, y_origin, DRAW_MODE_ABSOLUTE);
+            break;
+
+        default:
+            DrawTextGlyphs(x_origin + cmd->col, y_origin, cmd->text, cmd->arg1, pacing);
+            break;
+        }
+    }
+}
+
+/*
+Draw a text layout previously built by CompileTextLine(), with its column zero
+at the specified X/Y origin. `pacing` carries the typewriter delay state, and
+should be zeroed before drawing the first layout of a line.
+*/
+void DrawTextLayout(word x_origin, word y_origin, TextLayout *layout, TextPacing *pacing)
+{
+    DrawTextCommands(x_origin, y_origin, layout->commands, layout->count, pacing);
+}
+
+/*
+Draw a single line of text like DrawTextLine() does, keeping its compiled layout
+so the text doesn't have to be parsed again the next time it is drawn. The text
+is recognized by its address alone, so it must never change; string literals
+are fine. Lines that don't fit into one layout, or that can't be kept because
+the memory isn't there, are drawn by DrawTextLine() every time.
+*/
+void DrawStaticTextLine(word x_origin, word y_origin, char *text)
+{
+    TextLayout layout;
+    TextPacing pacing;
+    word slot = (FP_SEG(text) ^ FP_OFF(text)) % TEXT_LAYOUT_KEPT_LINES;
+
+    if (keptCommands == NULL) {
+        keptCommands = PROCESS_MALLOC(TEXT_LAYOUT_KEPT_CMDS * sizeof(TextCommand));
+    }
+
+    if (keptCommands != NULL && keptLayouts == NULL) {
+        keptLayouts = PROCESS_MALLOC(TEXT_LAYOUT_KEPT_LINES * sizeof *keptLayouts);
+        if (keptLayouts != NULL) {
+            memset(keptLayouts, 0, TEXT_LAYOUT_KEPT_LINES * sizeof *keptLayouts);
+        }
+    }
+
+    if (keptLayouts == NULL) {
+        DrawTextLine(x_origin, y_origin, text);
+        return;
+    }
+
+    if (keptLayouts[slot].text != text) {
+        word i;
+
+        if (*CompileTextLine(text, 0, &layout) != '\0') {
+            DrawTextLine(x_origin, y_origin, text);
+            return;
+        }
+
+        if (numKeptCommands + layout.count > TEXT_LAYOUT_KEPT_CMDS) {
+            for (i = 0; i < TEXT_LAYOUT_KEPT_LINES; i++) {
+                keptLayouts[i].text = NULL;
+            }
+
+            numKeptCommands = 0;
+        }
+
+        movmem(
+            layout.commands, keptCommands + numKeptCommands,
+            layout.count * sizeof(TextCommand)
+        );
+        keptLayouts[slot].text = text;
+        keptLayouts[slot].first = numKeptCommands;
+        keptLayouts[slot].count = layout.count;
+        numKeptCommands += layout.count;
+    }
+
+    pacing.delay = pacing.delayleft = 0;
+    DrawTextCommands(
+        x_origin, y_origin, keptCommands + keptLayouts[slot].first,
+        keptLayouts[slot].count, &pacing
+    );
+}
+#endif  /* TEXT_LAYOUT */
 
 /*
 Draw a single line of text with the first character at the specified X/Y origin.
@@ -447,9 +990,24 @@ NOTE: C's parser treats strings like "\xFC003" as hex literals with more than
 two digits, resulting in a compile-time error. In calling code, you'll see text
 broken up like "\xFC""003". This is intentional, and the only reasonable
 workaround. (Unless we go octal...)
+
+#ifdef TEXT_LAYOUT: The text is compiled by CompileTextLine() and drawn by
+DrawTextLayout(), a layout's worth at a time.
 */
 void DrawTextLine(word x_origin, word y_origin, char *text)
 {
+#ifdef TEXT_LAYOUT
+    TextLayout layout;
+    TextPacing pacing;
+
+    pacing.delay = pacing.delayleft = 0;
+    layout.endcol = 0;
+
+    do {
+        text = CompileTextLine(text, layout.endcol, &layout);
+        DrawTextLayout(x_origin, y_origin, &layout, &pacing);
+    } while (*text != '\0');
+#else
     register int x = 0;
     register word delay = 0;
     word delayleft = 0;
@@ -530,6 +1088,7 @@ void DrawTextLine(word x_origin, word y_origin, char *text)
 
         x++;
     }
+#endif  /* TEXT_LAYOUT */
 }
 
 /*
@@ -552,24 +1111,82 @@ static void LoadFontTileData(char *entry_name, byte *dest, word length)
     }
 }
 
+#ifdef FULLSCREEN_CACHE
+/*
+Return a pointer to the data for fullscreen image `image_num`, reading it into
+the least recently used cache slot if it isn't already in one. Slots are only
+allocated when first needed. Returns NULL if a slot could not be allocated.
+
+The data is kept exactly as stored in the group file: four consecutive 8,000
+byte planes, which is already the layout DrawFullscreenImage() copies out.
+*/
+static byte *FullscreenCacheData(word image_num)
+{
+    register word i;
+    word victim = 0;
+    FILE *fp;
+
+    for (i = 0; i < FULLSCREEN_CACHE; i++) {
+        if (fullscreenCache[i].data != NULL && fullscreenCache[i].image == image_num) {
+            fullscreenCache[i].lastused = ++fullscreenCacheClock;
+
+            return fullscreenCache[i].data;
+        }
+
+        /* Never-allocated slots have `lastused` 0 and get picked first. */
+        if (fullscreenCache[i].lastused < fullscreenCache[victim].lastused) {
+            victim = i;
+        }
+    }
+
+    if (fullscreenCache[victim].data == NULL) {
+        fullscreenCache[victim].data = PROCESS_MALLOC(32000);
+        if (fullscreenCache[victim].data == NULL) return NULL;
+    }
+
+    fp = GroupEntryFp(fullscreenImageNames[image_num]);
+    fread(fullscreenCache[victim].data, 32000, 1, fp);
+    fclose(fp);
+
+    fullscreenCache[victim].image = image_num;
+    fullscreenCache[victim].lastused = ++fullscreenCacheClock;
+
+    return fullscreenCache[victim].data;
+}
+#endif  /* FULLSCREEN_CACHE */
+
 /*
 Replace the entire screen contents with a full-size (320x200) image.
+
+#ifdef FULLSCREEN_CACHE: The image comes out of FullscreenCacheData(). miscData
+is only used if the cache can't get memory, so it's left alone for the demo and
+tile attribute data.
 */
 void DrawFullscreenImage(word image_num)
 {
     byte *destbase = MK_FP(0xa000, 0);
+    byte *src;
 
     if (image_num != IMAGE_TITLE && image_num != IMAGE_CREDITS) {
         StopMusic();
     }
 
-    if (image_num != miscDataContents) {
-        FILE *fp = GroupEntryFp(fullscreenImageNames[image_num]);
+#ifdef FULLSCREEN_CACHE
+    src = FullscreenCacheData(image_num);
 
-        miscDataContents = image_num;
+    if (src == NULL)
+#endif  /* FULLSCREEN_CACHE */
+    {
+        if (image_num != miscDataContents) {
+            FILE *fp = GroupEntryFp(fullscreenImageNames[image_num]);
 
-        fread(miscData, 32000, 1, fp);
-        fclose(fp);
+            miscDataContents = image_num;
+
+            fread(miscData, 32000, 1, fp);
+            fclose(fp);
+        }
+
+        src = miscData;
     }
 
     EGA_MODE_DEFAULT();
@@ -586,7 +1203,7 @@ void DrawFullscreenImage(word image_num)
             outport(0x03c4, 0x0002 | mask);
 
             for (i = 0; i < 8000; i++) {
-                *(destbase + i) = *(miscData + i + srcbase);
+                *(destbase + i) = *(src + i + srcbase);
             }
 
             mask <<= 1;
@@ -862,6 +1479,11 @@ static void DrawMapRegion(void)
 
     if (scrollY > maxScrollY) scrollY = maxScrollY;
 
+#ifdef HAS_HEADLESS_MODE
+    /* The clamp above is game logic, so it has to happen either way */
+    if (isRenderSuppressed) return;
+
+#endif  /* HAS_HEADLESS_MODE */
     if (hasVScrollBackdrop && (scrollY % 2 != 0)) {
         /*
         This offset turns EGA_OFFSET_BDROP_EVEN into EGA_OFFSET_BDROP_ODD_Y, and
@@ -879,8 +1501,18 @@ static void DrawMapRegion(void)
 
     EGA_MODE_LATCHED_WRITE();
 
+#ifdef MAP_PAGING
+    if (scrollY < mapWindowY || scrollY + SCROLLH > mapWindowY + mapWindowRows) {
+        PageInMapWindow(scrollY + (SCROLLH / 2));
+    }
+
+    /* Rows are counted from the top of the part of the map that's paged in */
+    ymapmax = (mapWindowBase - mapData.w) + ((scrollY + SCROLLH - mapWindowY) << mapYPower);
+    ymap = (mapWindowBase - mapData.w) + ((scrollY - mapWindowY) << mapYPower);
+#else
     ymapmax = (scrollY + SCROLLH) << mapYPower;
     ymap = scrollY << mapYPower;
+#endif  /* MAP_PAGING */
 
     do {
         register int x = 0;
@@ -910,6 +1542,102 @@ static void DrawMapRegion(void)
     } while (ymap < ymapmax);
 }
 
+#ifdef SPRITE_CLIP
+/*
+Record which map cells inside the game window at the current scrollX/scrollY
+have the "in front" attribute. The table stays good until the window moves,
+since SetMapTile() keeps it current and LoadMapData() throws it out.
+*/
+static void BuildInFrontMask(void)
+{
+    register word x;
+    word y;
+    word *mapcell;
+
+    for (y = 0; y < SCROLLH; y++) {
+        mapcell = MAP_CELL_ADDR(scrollX, scrollY + y);
+        inFrontRows[y] = false;
+
+        for (x = 0; x < SCROLLW; x++) {
+            inFrontMask[y][x] = TILE_IN_FRONT(*(mapcell + x)) != 0;
+            inFrontRows[y] |= inFrontMask[y][x];
+        }
+    }
+
+    inFrontMaskX = scrollX;
+    inFrontMaskY = scrollY;
+    isInFrontMaskValid = true;
+}
+
+/*
+Clip a run of `length` tiles against a window `limit` tiles long, where `start`
+is the position of the first tile relative to the window's first tile. This is
+unsigned, so a run starting before the window has a `start` that wrapped around
+through zero. On return, `skip` is the number of tiles that fall before the
+window and `count` is the number that fall inside it. Returns false if none do.
+*/
+static bool ClipTileSpan(word start, word length, word limit, word *skip, word *count)
+{
+    word first = start < limit ? 0 : -start;
+
+    if (first >= length) return false;
+
+    *skip = first;
+    *count = length - first;
+    if (*count > limit - (word)(start + first)) {
+        *count = limit - (word)(start + first);
+    }
+
+    return true;
+}
+
+/*
+Draw the part of a `width` by `height` tile sprite, top-left tile at x,y_top,
+that falls inside the game window. When `flipped` is true the source rows go
+bottom-to-top. When `behind` is true, tiles over in-front map cells are skipped.
+*/
+static void DrawSpriteClipped(
+    byte *src, word x, word y_top, word width, word height, DrawFunction drawfn,
+    bool flipped, bool behind
+) {
+    register word col;
+    word skipcols, numcols, skiprows, numrows;
+    word row, lastrow, scol;
+    byte *rowsrc;
+
+    if (!ClipTileSpan(x - scrollX, width, SCROLLW, &skipcols, &numcols)) return;
+    if (!ClipTileSpan(y_top - scrollY, height, SCROLLH, &skiprows, &numrows)) return;
+
+    if (behind && (
+        !isInFrontMaskValid || inFrontMaskX != scrollX || inFrontMaskY != scrollY
+    )) {
+        BuildInFrontMask();
+    }
+
+    scol = (x + skipcols) - scrollX;
+    row = (y_top + skiprows) - scrollY;
+    lastrow = row + numrows;
+
+    for (; row < lastrow; row++, skiprows++) {
+        rowsrc = src + ((
+            (flipped ? height - 1 - skiprows : skiprows) * width
+        ) + skipcols) * 40;
+
+        if (behind && inFrontRows[row]) {
+            for (col = 0; col < numcols; col++, rowsrc += 40) {
+                if (!inFrontMask[row][scol + col]) {
+                    drawfn(rowsrc, scol + col + 1, row + 1);
+                }
+            }
+        } else {
+            for (col = 0; col < numcols; col++, rowsrc += 40) {
+                drawfn(rowsrc, scol + col + 1, row + 1);
+            }
+        }
+    }
+}
+#endif  /* SPRITE_CLIP */
+
 /*
 Is any part of the sprite frame at x,y visible within the screen's scroll area?
 */
@@ -1216,6 +1944,10 @@ void DrawSprite(word sprite_type, word frame, word x_origin, word y_origin, word
     byte *src;
     DrawFunction drawfn;
 
+#ifdef HAS_HEADLESS_MODE
+    if (isRenderSuppressed) return;
+
+#endif  /* HAS_HEADLESS_MODE */
     EGA_MODE_DEFAULT();
 
     offset = *(actorInfoData + sprite_type) + (frame * 4);
@@ -1239,6 +1971,30 @@ void DrawSprite(word sprite_type, word frame, word x_origin, word y_origin, word
         break;
     }
 
+#ifdef SPRITE_CLIP
+    if (mode == DRAW_MODE_FLIPPED) {
+        DrawSpriteClipped(
+            src, x_origin, (y_origin - height) + 1, width, height,
+            DrawSpriteTileFlipped, true, true
+        );
+
+        return;
+    } else if (mode == DRAW_MODE_IN_FRONT) {
+        DrawSpriteClipped(
+            src, x_origin, (y_origin - height) + 1, width, height, drawfn, false, false
+        );
+
+        return;
+    } else if (mode != DRAW_MODE_ABSOLUTE) {
+        DrawSpriteClipped(
+            src, x_origin, (y_origin - height) + 1, width, height, drawfn, false, true
+        );
+        EGA_BIT_MASK_DEFAULT();
+
+        return;
+    }
+#endif  /* SPRITE_CLIP */
+
     /* `mode` would go to ax if this was a switch, which doesn't happen */
     if (mode == DRAW_MODE_FLIPPED)  goto flipped;
     if (mode == DRAW_MODE_IN_FRONT) goto infront;
@@ -1346,6 +2102,10 @@ void DrawPlayer(byte frame, word x_origin, word y_origin, word mode)
     byte *src;
     DrawFunction drawfn;
 
+#ifdef HAS_HEADLESS_MODE
+    if (isRenderSuppressed) return;
+
+#endif  /* HAS_HEADLESS_MODE */
     EGA_MODE_DEFAULT();
 
     /* NOTE: No default draw function. An unhandled `mode` will crash! */
@@ -1378,6 +2138,14 @@ void DrawPlayer(byte frame, word x_origin, word y_origin, word mode)
     y = (y_origin - height) + 1;
     src = playerTileData + *(playerInfoData + offset + 2);
 
+#ifdef SPRITE_CLIP
+    if (mode != DRAW_MODE_ABSOLUTE) {
+        DrawSpriteClipped(src, x, y, width, height, drawfn, false, mode != DRAW_MODE_IN_FRONT);
+
+        return;
+    }
+#endif  /* SPRITE_CLIP */
+
     /* `mode` would go to ax if this was a switch, which doesn't happen */
     if (mode == DRAW_MODE_IN_FRONT) goto infront;
     if (mode == DRAW_MODE_ABSOLUTE) goto absolute;
@@ -1444,13 +2212,37 @@ infront:
 
 /*
 Load cartoon data into system memory.
+
+#ifdef CARTOON_CACHE: The data gets its own allocation the first time through,
+and LoadMapData() leaves it alone from then on. If that allocation fails, this
+falls back to the map data area and its reload-after-every-map behavior.
 */
 static void LoadCartoonData(char *entry_name)
 {
     FILE *fp = GroupEntryFp(entry_name);
 
+#ifdef CARTOON_CACHE
+    if (cartoonData == NULL) {
+        cartoonData = PROCESS_MALLOC((word)lastGroupEntryLength);
+    }
+
+    fread(
+        cartoonData != NULL ? cartoonData : mapData.b,
+        (word)lastGroupEntryLength, 1, fp
+    );
+#else
     fread(mapData.b, (word)GroupEntryLength(entry_name), 1, fp);
+#endif  /* CARTOON_CACHE */
     fclose(fp);
+
+#ifdef SPRITE_CLIP
+    /* The cartoon data may have landed on top of the map. */
+    isInFrontMaskValid = false;
+#endif  /* SPRITE_CLIP */
+#ifdef LEVEL_RESTART
+    /* Likewise, in which case the journal can't take the map back any more. */
+    isLevelImageValid = false;
+#endif  /* LEVEL_RESTART */
 }
 
 /*
@@ -1477,7 +2269,11 @@ void DrawCartoon(byte frame, word x_origin, word y_origin)
     width = *(cartoonInfoData + offset + 1);
 
     y = (y_origin - height) + 1;
+#ifdef CARTOON_CACHE
+    src = (cartoonData != NULL ? cartoonData : mapData.b) + *(cartoonInfoData + offset + 2);
+#else
     src = mapData.b + *(cartoonInfoData + offset + 2);
+#endif  /* CARTOON_CACHE */
 
     for (;;) {
         DrawSpriteTile(src, x, y);
@@ -1700,25 +2496,230 @@ static void DrawFountains(void)
     }
 }
 
+#ifdef MAP_PAGING
 /*
-Return the map tile value at the passed x,y position.
+Return the address of the first row of map page `page` if it's in memory (not
+counting the copies of pages above other pages), otherwise NULL.
 */
-word GetMapTile(word x, word y)
+static word *MapPageHome(word page)
 {
-    return MAP_CELL_DATA(x, y);
+    word i;
+
+    if (page * MAP_PAGING >= mapWindowY && page * MAP_PAGING < mapWindowY + mapWindowRows) {
+        return mapWindowBase + ((page * MAP_PAGING - mapWindowY) << mapYPower);
+    }
+
+    for (i = 0; i < numMapSlots; i++) {
+        if (mapSlots[i].page == page) return mapSlots[i].base;
+    }
+
+    return NULL;
 }
 
 /*
-Lighten each area of the map that a light touches.
-
-The map defines the top edge of each column of the cone. This function fills all
-tiles south of the defined light actor until a south-blocking tile is hit.
+Write map page `page` from `src` to the swap file, if it has changed since it
+was last read from there.
 */
-static void DrawLights(void)
+static void StoreMapPage(word page, word *src)
+{
+    word pagebytes = (MAP_PAGING << mapYPower) * 2;
+
+    if (!mapPageDirty[page]) return;
+
+    fseek(mapSwapFp, (long)page * pagebytes, SEEK_SET);
+    fwrite(src, pagebytes, 1, mapSwapFp);
+    mapPageDirty[page] = false;
+}
+
+/*
+Copy map page `page` to `dest`, from wherever it is in memory or else from the
+swap file.
+*/
+static void LoadMapPage(word page, word *dest)
+{
+    word pagebytes = (MAP_PAGING << mapYPower) * 2;
+    word *home = MapPageHome(page);
+
+    if (home != NULL) {
+        movmem(home, dest, pagebytes);
+    } else {
+        fseek(mapSwapFp, (long)page * pagebytes, SEEK_SET);
+        fread(dest, pagebytes, 1, mapSwapFp);
+    }
+}
+
+/*
+Bring map page `page`, which must not already be in memory, into the slot that
+went the longest without being used. Whatever page was there is written back if
+it changed. Returns the address of the first row of the page.
+*/
+static word *PageInMapSlot(word page)
+{
+    word i, victim = 0;
+    word *base;
+
+    for (i = 1; i < numMapSlots; i++) {
+        if (mapSlots[i].lastused < mapSlots[victim].lastused) victim = i;
+    }
+
+    base = mapSlots[victim].base;
+
+    if (mapSlots[victim].page != WORD_MAX) {
+        StoreMapPage(mapSlots[victim].page, base);
+        mapSlots[victim].page = WORD_MAX;
+    }
+
+    LoadMapPage(page, base);
+    if (page != 0) LoadMapPage(page - 1, base - (MAP_PAGING << mapYPower));
+
+    mapSlots[victim].page = page;
+    mapSlots[victim].lastused = ++mapSlotClock;
+
+    return base;
+}
+
+/*
+Return the address of the first cell in map row y. Rows outside the window of
+pages around the game window are brought into a slot of their own if needed, or
+when there are no slots, the window moves to be around y instead.
+*/
+static word *MapRowAddr(word y)
+{
+    word page, i;
+
+    if (!isMapPaged || y >= mapRows || (y >= mapWindowY && y < mapWindowY + mapWindowRows)) {
+        return mapWindowBase + ((y - mapWindowY) << mapYPower);
+    }
+
+    page = y / MAP_PAGING;
+
+    for (i = 0; i < numMapSlots; i++) {
+        if (mapSlots[i].page == page) {
+            mapSlots[i].lastused = ++mapSlotClock;
+
+            return mapSlots[i].base + ((y % MAP_PAGING) << mapYPower);
+        }
+    }
+
+    if (numMapSlots == 0) {
+        PageInMapWindow(y);
+
+        return mapWindowBase + ((y - mapWindowY) << mapYPower);
+    }
+
+    return PageInMapSlot(page) + ((y % MAP_PAGING) << mapYPower);
+}
+
+/*
+Move the window of pages so that row y is close to its middle. Changed pages
+that are leaving memory get written to the swap file, the pages that are staying
+get moved to their new place, and the rest get taken out of the slots or read
+in.
+*/
+static void PageInMapWindow(word y)
+{
+    word page, top, i;
+    word oldtop = mapWindowY;
+    word pagebytes = (MAP_PAGING << mapYPower) * 2;
+    word windowpages = mapWindowRows / MAP_PAGING;
+    word maxtop = (((mapRows + MAP_PAGING - 1) / MAP_PAGING) - windowpages) * MAP_PAGING;
+
+    if (!isMapPaged) return;
+
+    top = y > mapWindowRows / 2 ? y - (mapWindowRows / 2) : 0;
+    top -= top % MAP_PAGING;
+    if (top > maxtop) top = maxtop;
+
+    if (top == oldtop) return;
+
+    for (page = oldtop / MAP_PAGING; page < (oldtop / MAP_PAGING) + windowpages; page++) {
+        if (page * MAP_PAGING >= top && page * MAP_PAGING < top + mapWindowRows) continue;
+
+        StoreMapPage(page, mapWindowBase + ((page * MAP_PAGING - oldtop) << mapYPower));
+    }
+
+    if (top > oldtop && top < oldtop + mapWindowRows) {
+        memmove(
+            mapWindowBase, mapWindowBase + ((top - oldtop) << mapYPower),
+            ((oldtop + mapWindowRows - top) << mapYPower) * 2
+        );
+    } else if (top < oldtop && oldtop < top + mapWindowRows) {
+        memmove(
+            mapWindowBase + ((oldtop - top) << mapYPower), mapWindowBase,
+            ((top + mapWindowRows - oldtop) << mapYPower) * 2
+        );
+    }
+
+    mapWindowY = top;
+
+    for (page = top / MAP_PAGING; page < (top / MAP_PAGING) + windowpages; page++) {
+        word *dest = mapWindowBase + ((page * MAP_PAGING - top) << mapYPower);
+
+        if (page * MAP_PAGING >= oldtop && page * MAP_PAGING < oldtop + mapWindowRows) continue;
+
+        for (i = 0; i < numMapSlots; i++) {
+            if (mapSlots[i].page == page) break;
+        }
+
+        if (i < numMapSlots) {
+            movmem(mapSlots[i].base, dest, pagebytes);
+            mapSlots[i].page = WORD_MAX;
+            mapSlots[i].lastused = 0;
+        } else {
+            fseek(mapSwapFp, (long)page * pagebytes, SEEK_SET);
+            fread(dest, pagebytes, 1, mapSwapFp);
+        }
+    }
+
+    if (top != 0) LoadMapPage((top / MAP_PAGING) - 1, mapData.w);
+}
+
+/*
+Store `value` at x,y in any copies of the map page holding row y that are kept
+above other pages.
+*/
+static void MirrorMapCell(word value, word x, word y)
+{
+    word below = (y / MAP_PAGING) + 1;
+    word offset = ((MAP_PAGING - (y % MAP_PAGING)) << mapYPower) - x;
+    word i;
+
+    if (!isMapPaged) return;
+
+    if (mapWindowY == below * MAP_PAGING) {
+        *(mapWindowBase - offset) = value;
+    }
+
+    for (i = 0; i < numMapSlots; i++) {
+        if (mapSlots[i].page == below) {
+            *(mapSlots[i].base - offset) = value;
+        }
+    }
+}
+#endif  /* MAP_PAGING */
+
+/*
+Return the map tile value at the passed x,y position.
+*/
+word GetMapTile(word x, word y)
+{
+    return MAP_CELL_DATA(x, y);
+}
+
+/*
+Lighten each area of the map that a light touches.
+
+The map defines the top edge of each column of the cone. This function fills all
+tiles south of the defined light actor until a south-blocking tile is hit.
+*/
+static void DrawLights(void)
 {
     register word i;
 
     if (!areLightsActive) return;
+#ifdef HAS_HEADLESS_MODE
+    if (isRenderSuppressed) return;
+#endif  /* HAS_HEADLESS_MODE */
 
     EGA_MODE_DEFAULT();
 
@@ -2822,8 +3823,189 @@ Set map tile at x,y to `value`.
 */
 void SetMapTile(word value, word x, word y)
 {
+#if defined(DEMO_DESYNC_CHECK) && !defined(MAP_CHANGE_LOG)
+    {  /* for scope */
+        word i = x + (y << mapYPower);
+        mapHash += MAP_CELL_HASH(i, value) - MAP_CELL_HASH(i, MAP_CELL_DATA(x, y));
+    }
+
+#endif  /* DEMO_DESYNC_CHECK && !MAP_CHANGE_LOG */
+#ifdef HAS_MAP_JOURNAL
+    if (mapJournal != NULL && MAP_CELL_DATA(x, y) != value) {
+        word offset = x + (y << mapYPower);
+
+        if ((mapJournalCells[offset / 8] & (1 << (offset % 8))) != 0) {
+            ;  /* VOID: already journaled */
+        } else if (mapJournalLength < MAP_JOURNAL_SIZE) {
+            mapJournalCells[offset / 8] |= 1 << (offset % 8);
+            mapJournal[mapJournalLength].offset = offset;
+            mapJournal[mapJournalLength].value = MAP_CELL_DATA(x, y);
+            mapJournalLength++;
+        } else {
+            isMapJournalFull = true;
+        }
+    }
+
+#endif  /* HAS_MAP_JOURNAL */
+#ifdef MAP_CHANGE_LOG
+    if (MAP_CELL_DATA(x, y) != value) {
+        if (numMapChanges < MAP_CHANGE_LOG) {
+            mapChanges[numMapChanges].x = x;
+            mapChanges[numMapChanges].y = y;
+            mapChanges[numMapChanges].before = MAP_CELL_DATA(x, y);
+            mapChanges[numMapChanges].after = value;
+            numMapChanges++;
+        } else {
+            isMapChangeLogFull = true;
+        }
+    }
+
+#endif  /* MAP_CHANGE_LOG */
     MAP_CELL_DATA(x, y) = value;
+
+#ifdef MAP_PAGING
+    mapPageDirty[y / MAP_PAGING] = true;
+    MirrorMapCell(value, x, y);
+#endif  /* MAP_PAGING */
+
+#ifdef SPRITE_CLIP
+    if (
+        isInFrontMaskValid &&
+        x - inFrontMaskX < SCROLLW && y - inFrontMaskY < SCROLLH
+    ) {
+        /* The row flag may go stale-true here, which is harmless. */
+        inFrontMask[y - inFrontMaskY][x - inFrontMaskX] = TILE_IN_FRONT(value) != 0;
+        inFrontRows[y - inFrontMaskY] |= inFrontMask[y - inFrontMaskY][x - inFrontMaskX];
+    }
+#endif  /* SPRITE_CLIP */
+}
+
+#if defined(DEMO_DESYNC_CHECK) && defined(MAP_CHANGE_LOG)
+/*
+Bring `mapHash` up to date with the map changes logged since it was last
+updated. If the log ran out of room, the whole map is hashed again instead.
+*/
+static void HashMapChanges(void)
+{
+    word i;
+
+    if (isMapChangeLogFull) {
+        mapHash = 0;
+        for (i = 0; i <= WORD_MAX / 2; i++) {
+            mapHash += MAP_CELL_HASH(i, *(mapData.w + i));
+        }
+    } else {
+        for (i = numMapChangesHashed; i < numMapChanges; i++) {
+            word offset = mapChanges[i].x + (mapChanges[i].y << mapYPower);
+
+            mapHash += MAP_CELL_HASH(offset, mapChanges[i].after) -
+                MAP_CELL_HASH(offset, mapChanges[i].before);
+        }
+    }
+
+    numMapChangesHashed = numMapChanges;
+}
+
+/*
+Drop the logged map changes without hashing them. For when the map and `mapHash`
+were both just replaced with ones that already agree with each other.
+*/
+static void ForgetMapChanges(void)
+{
+    numMapChanges = numMapChangesHashed = 0;
+    isMapChangeLogFull = false;
+}
+#endif  /* DEMO_DESYNC_CHECK && MAP_CHANGE_LOG */
+
+#ifdef HAS_MAP_JOURNAL
+/*
+Allocate the map journal and its cell bits, if that hasn't happened yet. The
+journal is only allocated once its cell bits are. Returns true if it's there.
+*/
+static bool AllocateMapJournal(void)
+{
+    if (mapJournalCells == NULL) {
+        mapJournalCells = PROCESS_MALLOC(((WORD_MAX / 2) + 1) / 8);
+        if (mapJournalCells == NULL) return false;
+
+        memset(mapJournalCells, 0, ((WORD_MAX / 2) + 1) / 8);
+    }
+
+    if (mapJournal == NULL) {
+        mapJournal = PROCESS_MALLOC(MAP_JOURNAL_SIZE * sizeof *mapJournal);
+    }
+
+    return mapJournal != NULL;
+}
+
+/*
+Make the current end of the journal a point the map can be rolled back to. Every
+change made after this gets journaled again, even to cells changed before.
+*/
+static void StartMapJournalEpoch(void)
+{
+    word i;
+
+    for (i = mapJournalEpoch; i < mapJournalLength; i++) {
+        mapJournalCells[mapJournal[i].offset / 8] &= ~(1 << (mapJournal[i].offset % 8));
+    }
+
+    mapJournalEpoch = mapJournalLength;
+}
+
+/*
+Empty the journal, keeping the map as it is now.
+*/
+static void ResetMapJournal(void)
+{
+    StartMapJournalEpoch();
+    mapJournalLength = mapJournalEpoch = 0;
+    isMapJournalFull = false;
+}
+
+/*
+Undo journaled map changes, newest first, until only `length` of them remain.
+*/
+static void RollBackMap(word length)
+{
+    while (mapJournalLength > length) {
+        word offset;
+
+        mapJournalLength--;
+        offset = mapJournal[mapJournalLength].offset;
+        *(mapData.w + offset) = mapJournal[mapJournalLength].value;
+        mapJournalCells[offset / 8] &= ~(1 << (offset % 8));
+    }
+
+    if (mapJournalEpoch > length) mapJournalEpoch = length;
+    StartMapJournalEpoch();
+
+#if defined(DEMO_DESYNC_CHECK) && defined(MAP_CHANGE_LOG)
+    /* The caller put back the `mapHash` that goes with the restored map */
+    ForgetMapChanges();
+#endif  /* DEMO_DESYNC_CHECK && MAP_CHANGE_LOG */
+}
+#endif  /* HAS_MAP_JOURNAL */
+
+#ifdef MAP_CHANGE_LOG
+/*
+Empty the map change log at the start of a tick. Whatever reads the log has to
+do so before this happens again. Map loads and rollbacks happen between ticks
+and are not logged.
+
+#ifdef DEMO_DESYNC_CHECK: The last tick's changes are hashed into `mapHash`
+first.
+*/
+static void StartMapChangeLog(void)
+{
+#ifdef DEMO_DESYNC_CHECK
+    HashMapChanges();
+    numMapChangesHashed = 0;
+#endif  /* DEMO_DESYNC_CHECK */
+    numMapChanges = 0;
+    isMapChangeLogFull = false;
 }
+#endif  /* MAP_CHANGE_LOG */
 
 /*
 Handle one frame of mystery wall movement.
@@ -4473,7 +5655,13 @@ static void ActHintGlobe(word index)
             sawAutoHintGlobe = true;
         }
 
-        if ((cmdNorth && scooterMounted == 0) || !sawAutoHintGlobe) {
+        if (
+            ((cmdNorth && scooterMounted == 0) || !sawAutoHintGlobe)
+#ifdef HAS_HEADLESS_MODE
+            /* Nobody is there to dismiss the dialog; it would wait forever */
+            && !isRenderSuppressed
+#endif  /* HAS_HEADLESS_MODE */
+        ) {
             StartSound(SND_HINT_DIALOG_ALERT);
             ShowHintGlobeMessage(act->data5);
         }
@@ -6457,11 +7645,21 @@ void NewShard(word sprite_type, word frame, word x_origin, word y_origin)
     INTERESTING: This never gets reset, so shard behavior is different for each
     run through the demo playback.
     */
+#ifdef RNG_CONTEXT
+    word xmode;
+#else
     static word xmode = 0;
+#endif  /* RNG_CONTEXT */
     word i;
 
+#ifdef RNG_CONTEXT
+    randomState.shardxmode++;
+    if (randomState.shardxmode == 5) randomState.shardxmode = 0;
+    xmode = randomState.shardxmode;
+#else
     xmode++;
     if (xmode == 5) xmode = 0;
+#endif  /* RNG_CONTEXT */
 
     for (i = 0; i < numShards; i++) {
         Shard *sh = shards + i;
@@ -6843,7 +8041,11 @@ will be very close, and we don't have to re-test nearly as many variables.
 */
 static bool TryPounce(int recoil)
 {
+#ifdef HAS_TICK_STATICS
+#   define lastrecoil tickStatics.lastrecoil
+#else
     static word lastrecoil;
+#endif  /* HAS_TICK_STATICS */
 
     if (playerDeadTime != 0 || playerDizzyLeft != 0) return false;
 
@@ -6894,6 +8096,9 @@ static bool TryPounce(int recoil)
 
     return false;
 }
+#ifdef HAS_TICK_STATICS
+#undef lastrecoil
+#endif  /* HAS_TICK_STATICS */
 
 /*
 Cause the player pain, deduct health, and determine if the player becomes dead.
@@ -6942,6 +8147,157 @@ void NewPounceDecoration(word x, word y)
     NewDecoration(SPR_POUNCE_DEBRIS, 6, x,     y - 2, DIR8_WEST,      2);
 }
 
+#ifdef SPRITE_FLAGS
+/*
+The properties of every sprite type that either explosions or the player can
+have an effect on. Sprite types that aren't listed have no SPF_* flags at all.
+*/
+static struct {
+    word sprite;
+    byte flags;
+} spriteFlagList[] = {
+    {SPR_BASKET, SPF_POUNCE},
+    {SPR_STAR, SPF_TOUCH | SPF_PRIZE},
+    {SPR_JUMP_PAD, SPF_POUNCE | SPF_TOUCH},
+    {SPR_ARROW_PISTON_W, SPF_EXPLODES | SPF_TOUCH | SPF_HURTS},
+    {SPR_ARROW_PISTON_E, SPF_EXPLODES | SPF_TOUCH | SPF_HURTS},
+    {SPR_FIREBALL, SPF_TOUCH | SPF_HURTS},
+    {SPR_6, SPF_TOUCH | SPF_HURTS},
+    {SPR_HEAD_SWITCH_BLUE, SPF_TOUCH},
+    {SPR_HEAD_SWITCH_RED, SPF_TOUCH},
+    {SPR_HEAD_SWITCH_GREEN, SPF_TOUCH},
+    {SPR_HEAD_SWITCH_YELLOW, SPF_TOUCH},
+    {SPR_JUMP_PAD_ROBOT, SPF_POUNCE},
+    {SPR_SPIKES_FLOOR, SPF_EXPLODES | SPF_TOUCH | SPF_HURTS},
+    {SPR_SPIKES_FLOOR_RECIP, SPF_EXPLODES | SPF_TOUCH | SPF_HURTS},
+    {SPR_SAW_BLADE, SPF_EXPLODES | SPF_TOUCH | SPF_HURTS},
+    {SPR_CABBAGE, SPF_EXPLODES | SPF_POUNCE | SPF_HURTS},
+    {SPR_POWER_UP, SPF_TOUCH | SPF_PRIZE},
+    {SPR_BARREL, SPF_POUNCE},
+    {SPR_GRN_TOMATO, SPF_TOUCH | SPF_PRIZE},
+    {SPR_RED_TOMATO, SPF_TOUCH | SPF_PRIZE},
+    {SPR_YEL_PEAR, SPF_TOUCH | SPF_PRIZE},
+    {SPR_ONION, SPF_TOUCH | SPF_PRIZE},
+    {SPR_EXIT_SIGN, SPF_TOUCH},
+    {SPR_SPEAR, SPF_EXPLODES | SPF_TOUCH | SPF_HURTS},
+    {SPR_GREEN_SLIME, SPF_TOUCH | SPF_HURTS},
+    {SPR_FLYING_WISP, SPF_TOUCH | SPF_HURTS},
+    {SPR_TWO_TONS_CRUSHER, SPF_TOUCH | SPF_HURTS},
+    {SPR_JUMPING_BULLET, SPF_EXPLODES | SPF_TOUCH | SPF_HURTS},
+    {SPR_STONE_HEAD_CRUSHER, SPF_EXPLODES | SPF_TOUCH | SPF_HURTS},
+    {SPR_48, SPF_TOUCH | SPF_HURTS},
+    {SPR_PYRAMID, SPF_TOUCH | SPF_HURTS},
+    {SPR_50, SPF_TOUCH | SPF_HURTS},
+    {SPR_GHOST, SPF_EXPLODES | SPF_POUNCE | SPF_HURTS},
+    {SPR_MOON, SPF_EXPLODES | SPF_POUNCE | SPF_HURTS},
+    {SPR_HEART_PLANT, SPF_EXPLODES | SPF_TOUCH | SPF_HURTS},
+    {SPR_BOMB_IDLE, SPF_TOUCH | SPF_PRIZE},
+    {SPR_FOOT_SWITCH_KNOB, SPF_POUNCE | SPF_TOUCH},
+    {SPR_SPIKES_FLOOR_BENT, SPF_TOUCH | SPF_HURTS},
+    {SPR_MONUMENT, SPF_TOUCH},
+    {SPR_BABY_GHOST, SPF_EXPLODES | SPF_POUNCE | SPF_HURTS},
+    {SPR_PROJECTILE, SPF_TOUCH | SPF_HURTS},
+    {SPR_ROAMER_SLUG, SPF_EXPLODES | SPF_POUNCE | SPF_TOUCH},
+    {SPR_PIPE_CORNER_N, SPF_TOUCH},
+    {SPR_PIPE_CORNER_S, SPF_TOUCH},
+    {SPR_PIPE_CORNER_W, SPF_TOUCH},
+    {SPR_PIPE_CORNER_E, SPF_TOUCH},
+    {SPR_74, SPF_EXPLODES | SPF_POUNCE},
+    {SPR_BABY_GHOST_EGG, SPF_EXPLODES | SPF_POUNCE},
+    {SPR_SHARP_ROBOT_FLOOR, SPF_EXPLODES | SPF_TOUCH | SPF_HURTS},
+    {SPR_SHARP_ROBOT_CEIL, SPF_EXPLODES | SPF_TOUCH | SPF_HURTS},
+    {SPR_HAMBURGER, SPF_TOUCH | SPF_PRIZE},
+    {SPR_CLAM_PLANT, SPF_EXPLODES | SPF_TOUCH | SPF_HURTS},
+    {SPR_84, SPF_EXPLODES | SPF_TOUCH | SPF_HURTS},
+    {SPR_GRAPES, SPF_TOUCH | SPF_PRIZE},
+    {SPR_PARACHUTE_BALL, SPF_EXPLODES | SPF_POUNCE | SPF_HURTS},
+    {SPR_SPIKES_E, SPF_EXPLODES | SPF_TOUCH | SPF_HURTS},
+    {SPR_SPIKES_E_RECIP, SPF_EXPLODES | SPF_TOUCH | SPF_HURTS},
+    {SPR_SPIKES_W, SPF_EXPLODES | SPF_TOUCH | SPF_HURTS},
+    {SPR_SPARK, SPF_EXPLODES | SPF_TOUCH | SPF_HURTS},
+    {SPR_DANCING_MUSHROOM, SPF_TOUCH | SPF_PRIZE},
+    {SPR_EYE_PLANT, SPF_EXPLODES},
+    {SPR_96, SPF_EXPLODES},
+    {SPR_RED_JUMPER, SPF_EXPLODES | SPF_POUNCE | SPF_HURTS},
+    {SPR_BOSS, SPF_POUNCE | SPF_HURTS},
+    {SPR_PIPE_END, SPF_TOUCH},
+    {SPR_SUCTION_WALKER, SPF_EXPLODES | SPF_POUNCE | SPF_HURTS},
+    {SPR_TRANSPORTER, SPF_TOUCH},
+    {SPR_SPIT_WALL_PLANT_E, SPF_EXPLODES | SPF_TOUCH | SPF_HURTS},
+    {SPR_SPIT_WALL_PLANT_W, SPF_EXPLODES | SPF_TOUCH | SPF_HURTS},
+    {SPR_SPITTING_TURRET, SPF_EXPLODES | SPF_POUNCE | SPF_HURTS},
+    {SPR_SCOOTER, SPF_TOUCH},
+    {SPR_RED_CHOMPER, SPF_EXPLODES | SPF_POUNCE | SPF_HURTS},
+    {SPR_PINK_WORM, SPF_EXPLODES | SPF_POUNCE},
+    {SPR_HINT_GLOBE, SPF_EXPLODES},
+    {SPR_PUSHER_ROBOT, SPF_EXPLODES | SPF_POUNCE | SPF_HURTS},
+    {SPR_SENTRY_ROBOT, SPF_EXPLODES | SPF_POUNCE | SPF_HURTS},
+    {SPR_PINK_WORM_SLIME, SPF_EXPLODES | SPF_TOUCH | SPF_HURTS},
+    {SPR_DRAGONFLY, SPF_EXPLODES | SPF_POUNCE | SPF_HURTS},
+    {SPR_BOTTLE_DRINK, SPF_TOUCH | SPF_PRIZE},
+    {SPR_GRN_GOURD, SPF_TOUCH | SPF_PRIZE},
+    {SPR_BLU_SPHERES, SPF_TOUCH | SPF_PRIZE},
+    {SPR_POD, SPF_TOUCH | SPF_PRIZE},
+    {SPR_PEA_PILE, SPF_TOUCH | SPF_PRIZE},
+    {SPR_LUMPY_FRUIT, SPF_TOUCH | SPF_PRIZE},
+    {SPR_HORN, SPF_TOUCH | SPF_PRIZE},
+    {SPR_RED_BERRIES, SPF_TOUCH | SPF_PRIZE},
+    {SPR_IVY_PLANT, SPF_POUNCE | SPF_HURTS},
+    {SPR_YEL_FRUIT_VINE, SPF_TOUCH | SPF_PRIZE},
+    {SPR_HEADDRESS, SPF_TOUCH | SPF_PRIZE},
+    {SPR_EXIT_MONSTER_W, SPF_TOUCH},
+    {SPR_SMALL_FLAME, SPF_TOUCH | SPF_HURTS},
+    {SPR_TULIP_LAUNCHER, SPF_POUNCE},
+    {SPR_ROTATING_ORNAMENT, SPF_TOUCH | SPF_PRIZE},
+    {SPR_BLU_CRYSTAL, SPF_TOUCH | SPF_PRIZE},
+    {SPR_RED_CRYSTAL, SPF_TOUCH | SPF_PRIZE},
+    {SPR_BEAR_TRAP, SPF_TOUCH},
+    {SPR_ROOT, SPF_TOUCH | SPF_PRIZE},
+    {SPR_REDGRN_BERRIES, SPF_TOUCH | SPF_PRIZE},
+    {SPR_RED_GOURD, SPF_TOUCH | SPF_PRIZE},
+    {SPR_GRN_EMERALD, SPF_TOUCH | SPF_PRIZE},
+    {SPR_CLR_DIAMOND, SPF_TOUCH | SPF_PRIZE},
+    {SPR_EXIT_PLANT, SPF_TOUCH},
+    {SPR_BIRD, SPF_EXPLODES | SPF_POUNCE | SPF_HURTS},
+    {SPR_ROCKET, SPF_EXPLODES | SPF_POUNCE},
+    {SPR_INVINCIBILITY_CUBE, SPF_TOUCH | SPF_PRIZE},
+    {SPR_CYA_DIAMOND, SPF_TOUCH | SPF_PRIZE},
+    {SPR_RED_DIAMOND, SPF_TOUCH | SPF_PRIZE},
+    {SPR_GRY_OCTAHEDRON, SPF_TOUCH | SPF_PRIZE},
+    {SPR_BLU_EMERALD, SPF_TOUCH | SPF_PRIZE},
+    {SPR_THRUSTER_JET, SPF_TOUCH | SPF_HURTS},
+    {SPR_HEADPHONES, SPF_TOUCH | SPF_PRIZE},
+    {SPR_BANANAS, SPF_TOUCH | SPF_PRIZE},
+    {SPR_RED_LEAFY, SPF_TOUCH | SPF_PRIZE},
+    {SPR_BRN_PEAR, SPF_TOUCH | SPF_PRIZE},
+    {SPR_CANDY_CORN, SPF_TOUCH | SPF_PRIZE},
+    {SPR_FLAME_PULSE_W, SPF_TOUCH | SPF_HURTS},
+    {SPR_FLAME_PULSE_E, SPF_TOUCH | SPF_HURTS},
+    {SPR_RED_SLIME, SPF_TOUCH | SPF_HURTS},
+#ifdef HAS_ACT_EXIT_MONSTER_N
+    {SPR_EXIT_MONSTER_N, SPF_TOUCH},
+#endif  /* HAS_ACT_EXIT_MONSTER_N */
+};
+#define NUM_SPRITE_FLAG_LIST (sizeof spriteFlagList / sizeof spriteFlagList[0])
+
+/*
+SPF_* flags for each sprite type, indexed by sprite type number.
+*/
+static byte spriteFlags[NUM_SPRITE_TYPES];
+
+/*
+Expand the sprite property list into a flag table that can be indexed directly.
+*/
+static void InitializeSpriteFlags(void)
+{
+    word i;
+
+    for (i = 0; i < NUM_SPRITE_FLAG_LIST; i++) {
+        spriteFlags[spriteFlagList[i].sprite] |= spriteFlagList[i].flags;
+    }
+}
+#endif  /* SPRITE_FLAGS */
+
 /*
 Can the passed sprite/frame be destroyed by an explosion?
 
@@ -6951,6 +8307,9 @@ explodable.
 */
 static bool CanExplode(word sprite_type, word frame, word x_origin, word y_origin)
 {
+#ifdef SPRITE_FLAGS
+    if (spriteFlags[sprite_type] & SPF_EXPLODES) {
+#else
     switch (sprite_type) {
     case SPR_ARROW_PISTON_W:
     case SPR_ARROW_PISTON_E:
@@ -6993,6 +8352,7 @@ static bool CanExplode(word sprite_type, word frame, word x_origin, word y_origi
     case SPR_74:  /* probably for ACT_BABY_GHOST_EGG_PROX; never happens */
     case SPR_84:  /* " " " ACT_CLAM_PLANT_CEIL " " " */
     case SPR_96:  /* " " " ACT_EYE_PLANT_CEIL " " " */
+#endif  /* SPRITE_FLAGS */
         if (sprite_type == SPR_HINT_GLOBE) {
             NewActor(ACT_SCORE_EFFECT_12800, x_origin, y_origin);
         }
@@ -7070,11 +8430,21 @@ static bool InteractPlayer(word index, word sprite_type, word frame, word x, wor
 
     if (!IsSpriteVisible(sprite_type, frame, x, y)) return true;
 
+#ifdef SPRITE_FLAGS
+    /* Most actors don't react to the player at all; skip all the tests below */
+    if ((spriteFlags[sprite_type] & (SPF_POUNCE | SPF_TOUCH)) == 0) return false;
+
+#endif  /* SPRITE_FLAGS */
     offset = *(actorInfoData + sprite_type) + (frame * 4);
     height = *(actorInfoData + offset);
     width = *(actorInfoData + offset + 1);
 
     isPounceReady = false;
+#ifdef SPRITE_FLAGS
+    if ((spriteFlags[sprite_type] & SPF_POUNCE) == 0) {
+        ;  /* nothing done on touch alone ever looks at isPounceReady */
+    } else
+#endif  /* SPRITE_FLAGS */
     if (sprite_type == SPR_BOSS) {
         height = 7;
 
@@ -8023,6 +9393,18 @@ static void interrupt KeyboardInterruptService(void)
     outportb(0x0061, inportb(0x0061) & ~0x80);
 
     if (lastScancode != SCANCODE_EXTENDED) {
+#ifdef INPUT_EVENTS
+        if (!isInGame) {
+            ;  /* VOID: nothing drains the queue outside of the game */
+        } else if ((inputEventTail + 1) % INPUT_EVENTS != inputEventHead) {
+            inputEvents[inputEventTail].scancode = lastScancode;
+            inputEvents[inputEventTail].time = interruptClock;
+            inputEventTail = (inputEventTail + 1) % INPUT_EVENTS;
+        } else {
+            numDroppedInputEvents++;
+        }
+
+#endif  /* INPUT_EVENTS */
         if ((lastScancode & 0x80) != 0) {
             isKeyDown[lastScancode & 0x7f] = false;
         } else {
@@ -8037,89 +9419,365 @@ static void interrupt KeyboardInterruptService(void)
     }
 }
 
+#ifdef HAS_SERIAL_PORT
 /*
-Update the programmable interval timer with the next PC speaker sound chunk.
-This is also the central pacemaker for game clock ticks.
+Respond to serial port interrupts. Received bytes are stored for the game to
+read, and each time the transmitter empties the next byte waiting to be sent is
+fed into it. Once nothing is waiting, the transmitter interrupt is turned off
+until SendRelayByte() turns it back on.
 */
-void PCSpeakerService(void)
+static void interrupt RelayInterruptService(void)
 {
-    static word soundCursor = 0;
-
-    gameTickCount++;
+    byte source;
 
-    if (isNewSound) {
-        isNewSound = false;
-        soundCursor = 0;
-        enableSpeaker = true;
-    }
+    while (((source = inportb(RELAY_PORT + 2)) & 0x01) == 0) {
+        switch (source & 0x06) {
+        case 0x04:  /* received data */
+            relayReceiveBuffer[relayReceiveTail] = inportb(RELAY_PORT);
 
-    if (*(soundDataPtr[activeSoundIndex] + soundCursor) == END_SOUND) {
-        enableSpeaker = false;
-        activeSoundPriority = 0;
+            /* When the buffer is full, the byte is dropped */
+            if ((relayReceiveTail + 1) % RELAY_BUFFER_SIZE != relayReceiveHead) {
+                relayReceiveTail = (relayReceiveTail + 1) % RELAY_BUFFER_SIZE;
+            }
+            break;
 
-        outportb(0x0061, inportb(0x0061) & ~0x02);
-    }
+        case 0x02:  /* transmitter empty */
+            if (relaySendHead != relaySendTail) {
+                outportb(RELAY_PORT, relaySendBuffer[relaySendHead]);
+                relaySendHead = (relaySendHead + 1) % RELAY_BUFFER_SIZE;
+            } else {
+                outportb(RELAY_PORT + 1, 0x01);
+            }
+            break;
 
-    if (enableSpeaker) {
-        word sample = *(soundDataPtr[activeSoundIndex] + soundCursor);
+        case 0x06:  /* line status; reading it is enough */
+            inportb(RELAY_PORT + 5);
+            break;
 
-        if (sample == 0 && isSoundEnabled) {
-            outportb(0x0061, inportb(0x0061) & ~0x03);
-        } else if (isSoundEnabled) {
-            outportb(0x0043, 0xb6);
-            outportb(0x0042, (byte) (sample & 0x00ff));
-            outportb(0x0042, (byte) (sample >> 8));
-            outportb(0x0061, inportb(0x0061) | 0x03);
+        default:  /* modem status; likewise */
+            inportb(RELAY_PORT + 6);
+            break;
         }
-
-        soundCursor++;
-    } else {
-        outportb(0x0061, inportb(0x0061) & ~0x02);
     }
+
+    outportb(0x0020, 0x20);
 }
 
 /*
-Write a page of "PC-ASCII" text and attributes to the screen, then emit a series
-of newline characters to ensure the text cursor clears the bottom of what was
-just written.
+Set up the serial port: 8 data bits, no parity, 1 stop bit, with interrupts for
+each byte received. The spectator relay runs at 9,600 baud and the agent server
+at 115,200.
 */
-static void DrawFullscreenText(char *entry_name)
+static void OpenRelayPort(void)
 {
-    FILE *fp = GroupEntryFp(entry_name);
-    byte *dest = MK_FP(0xb800, 0);
+    if (isRelayPortOpen) return;
 
-    fread(backdropTable, 4000, 1, fp);
-    movmem(backdropTable, dest, 4000);
-    printf("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n");  /* 22 of these */
+    disable();
+
+    savedRelayVector = getvect(RELAY_IRQ + 8);
+    setvect(RELAY_IRQ + 8, RelayInterruptService);
+
+    outportb(RELAY_PORT + 3, 0x80);  /* divisor latch access */
+    outportb(RELAY_PORT, RELAY_DIVISOR);
+    outportb(RELAY_PORT + 1, 0);
+    outportb(RELAY_PORT + 3, 0x03);  /* 8N1 */
+    outportb(RELAY_PORT + 4, 0x0b);  /* DTR, RTS, and OUT2 to pass the IRQ */
+    inportb(RELAY_PORT);             /* discard anything already received */
+    outportb(RELAY_PORT + 1, 0x01);  /* interrupt on received data */
+
+    outportb(0x0021, inportb(0x0021) & ~(1 << RELAY_IRQ));
+
+    relaySendHead = relaySendTail = relayReceiveHead = relayReceiveTail = 0;
+    isRelayPortOpen = true;
+
+    enable();
 }
 
 /*
-Exit the program cleanly.
-
-Saves the configuration file, restores the keyboard interrupt handler, graphics,
-and AdLib. Removes the temporary save file, displays a text page, and returns to
-DOS.
+Turn off the serial port's interrupts and restore whatever was handling them.
 */
-static void ExitClean(void)
+static void CloseRelayPort(void)
 {
-    SaveConfigurationData(JoinPath(writePath, FILENAME_BASE ".CFG"));
+    if (!isRelayPortOpen) return;
 
     disable();
-    setvect(9, savedInt9);
-    enable();
 
-    FadeOut();
+    outportb(0x0021, inportb(0x0021) | (1 << RELAY_IRQ));
+    outportb(RELAY_PORT + 1, 0);
+    outportb(RELAY_PORT + 4, 0);
 
-    textmode(C80);
+    setvect(RELAY_IRQ + 8, savedRelayVector);
+    isRelayPortOpen = false;
 
-    /* Silence PC speaker */
-    outportb(0x0061, inportb(0x0061) & ~0x02);
+    enable();
+}
+
+/*
+Queue one byte to be sent through the serial port. If the send buffer is full,
+the byte is dropped. Records should only be queued once WaitRelaySendRoom() says
+they fit in whole, so that the other side never sees part of one.
+*/
+static void SendRelayByte(byte value)
+{
+    if ((relaySendTail + 1) % RELAY_BUFFER_SIZE == relaySendHead) return;
+
+    relaySendBuffer[relaySendTail] = value;
+    relaySendTail = (relaySendTail + 1) % RELAY_BUFFER_SIZE;
+
+    /* If the transmitter is already empty, this interrupts right away */
+    outportb(RELAY_PORT + 1, 0x03);
+}
+
+/*
+Return how many more bytes fit into the send buffer.
+*/
+static word RelaySendRoom(void)
+{
+    return (relaySendHead + RELAY_BUFFER_SIZE - relaySendTail - 1) % RELAY_BUFFER_SIZE;
+}
+
+/*
+Wait until `count` bytes fit into the send buffer.
+*/
+static void WaitRelaySendRoom(word count)
+{
+    while (RelaySendRoom() < count)
+        ;  /* VOID */
+}
+
+/*
+Return the next byte received through the serial port, or -1 if there is none.
+*/
+static int ReceiveRelayByte(void)
+{
+    byte value;
+
+    if (relayReceiveHead == relayReceiveTail) return -1;
+
+    value = relayReceiveBuffer[relayReceiveHead];
+    relayReceiveHead = (relayReceiveHead + 1) % RELAY_BUFFER_SIZE;
+
+    return value;
+}
+#endif  /* HAS_SERIAL_PORT */
+
+/*
+Update the programmable interval timer with the next PC speaker sound chunk.
+This is also the central pacemaker for game clock ticks.
+*/
+void PCSpeakerService(void)
+{
+    static word soundCursor = 0;
+
+#ifdef HAS_VIRTUAL_CLOCK
+    gameTickCount += clockStep;
+#else
+    gameTickCount++;
+#endif  /* HAS_VIRTUAL_CLOCK */
+
+    if (isNewSound) {
+        isNewSound = false;
+        soundCursor = 0;
+        enableSpeaker = true;
+    }
+
+    if (*(soundDataPtr[activeSoundIndex] + soundCursor) == END_SOUND) {
+        enableSpeaker = false;
+        activeSoundPriority = 0;
+
+        outportb(0x0061, inportb(0x0061) & ~0x02);
+    }
+
+    if (enableSpeaker) {
+        word sample = *(soundDataPtr[activeSoundIndex] + soundCursor);
+
+        if (sample == 0 && isSoundEnabled) {
+            outportb(0x0061, inportb(0x0061) & ~0x03);
+        } else if (isSoundEnabled) {
+            outportb(0x0043, 0xb6);
+            outportb(0x0042, (byte) (sample & 0x00ff));
+            outportb(0x0042, (byte) (sample >> 8));
+            outportb(0x0061, inportb(0x0061) | 0x03);
+        }
+
+        soundCursor++;
+    } else {
+        outportb(0x0061, inportb(0x0061) & ~0x02);
+    }
+}
+
+/*
+Write a page of "PC-ASCII" text and attributes to the screen, then emit a series
+of newline characters to ensure the text cursor clears the bottom of what was
+just written.
+*/
+static void DrawFullscreenText(char *entry_name)
+{
+    FILE *fp = GroupEntryFp(entry_name);
+    byte *dest = MK_FP(0xb800, 0);
+
+    fread(backdropTable, 4000, 1, fp);
+    movmem(backdropTable, dest, 4000);
+    printf("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n");  /* 22 of these */
+}
+
+#ifdef INPUT_EVENTS
+/*
+Read the interrupt clock. The timer interrupt updates it one half at a time, so
+interrupts are held off for the duration.
+*/
+static dword ReadInterruptClock(void)
+{
+    dword clock;
+
+    disable();
+    clock = interruptClock;
+    enable();
+
+    return clock;
+}
+
+/*
+Is the passed scancode bound to one of the player movement/action commands?
+*/
+static bool IsCommandScancode(byte scancode)
+{
+    return
+        scancode == scancodeWest || scancode == scancodeEast ||
+        scancode == scancodeNorth || scancode == scancodeSouth ||
+        scancode == scancodeJump || scancode == scancodeBomb;
+}
+
+/*
+Forget all latched key presses, once the game tick has seen them.
+*/
+static void ClearKeyLatches(void)
+{
+    memset(isKeyLatched, false, sizeof isKeyLatched);
+}
+
+/*
+Take all of the waiting key events off the queue. Every key pressed since the
+last call gets latched, so it counts as down for one tick even if it has already
+been released. The first command key press starts a latency measurement that
+RecordInputLatency() finishes once the frame is shown.
+
+If a dialog has been shown since the last call, the waiting events, latches, and
+latency measurement are all thrown away instead.
+*/
+static void DrainInputEvents(void)
+{
+    if (wasDialogShown) {
+        wasDialogShown = false;
+        inputEventHead = inputEventTail;
+        ClearKeyLatches();
+        isPressPending = false;
+
+        return;
+    }
+
+    while (inputEventHead != inputEventTail) {
+        byte scancode = inputEvents[inputEventHead].scancode;
+
+        if ((scancode & 0x80) == 0) {
+            isKeyLatched[scancode] = true;
+
+            if (!isPressPending && IsCommandScancode(scancode)) {
+                isPressPending = true;
+                pendingPressTime = inputEvents[inputEventHead].time;
+            }
+        }
+
+        inputEventHead = (inputEventHead + 1) % INPUT_EVENTS;
+    }
+}
+
+/*
+Called right after a frame is shown. If a command key press is waiting for its
+effect to be seen, add the time since the press to the latency histogram. If a
+dialog was shown in the meantime, the press is dropped by DrainInputEvents().
+*/
+static void RecordInputLatency(void)
+{
+    dword ms;
+
+    if (!isPressPending || wasDialogShown) return;
+
+    ms = ((ReadInterruptClock() - pendingPressTime) * 1000) / interruptClockRate;
+    latencyHistogram[
+        ms / LATENCY_BUCKET_MS < LATENCY_BUCKETS ? ms / LATENCY_BUCKET_MS : LATENCY_BUCKETS - 1
+    ]++;
+    isPressPending = false;
+}
+
+/*
+Write the latency histogram to LATENCY.JSN. Each bucket counts the key presses
+that took that many multiples of LATENCY_BUCKET_MS to be shown, and the last
+bucket also counts all of the ones that took longer.
+*/
+static void WriteInputLatency(void)
+{
+    word i;
+    FILE *fp = fopen(JoinPath(writePath, "LATENCY.JSN"), "w");
+
+    if (fp == NULL) return;
+
+    fprintf(fp,
+        "{\n  \"clock_hz\": %u,\n  \"bucket_ms\": %u,\n  \"dropped_events\": %u,\n"
+        "  \"histogram\": [",
+        interruptClockRate, LATENCY_BUCKET_MS, numDroppedInputEvents
+    );
+
+    for (i = 0; i < LATENCY_BUCKETS; i++) {
+        fprintf(fp, "%s%lu", i == 0 ? "" : ", ", latencyHistogram[i]);
+    }
+
+    fprintf(fp, "]\n}\n");
+    fclose(fp);
+}
+#endif  /* INPUT_EVENTS */
+
+/*
+Exit the program cleanly.
+
+Saves the configuration file, restores the keyboard interrupt handler, graphics,
+and AdLib. Removes the temporary save file, displays a text page, and returns to
+DOS.
+*/
+static void ExitClean(void)
+{
+    SaveConfigurationData(JoinPath(writePath, FILENAME_BASE ".CFG"));
+#ifdef INPUT_EVENTS
+    WriteInputLatency();
+#endif  /* INPUT_EVENTS */
+
+    disable();
+    setvect(9, savedInt9);
+    enable();
+
+#ifdef HAS_SERIAL_PORT
+    CloseRelayPort();
+
+#endif  /* HAS_SERIAL_PORT */
+    FadeOut();
+
+    textmode(C80);
+
+    /* Silence PC speaker */
+    outportb(0x0061, inportb(0x0061) & ~0x02);
 
     StopAdLib();
 
     /* BUG: `writePath` is not considered here! */
     remove(FILENAME_BASE ".SVT");
 
+#ifdef MAP_PAGING
+    if (mapSwapFp != NULL) {
+        fclose(mapSwapFp);
+        remove(JoinPath(writePath, FILENAME_BASE ".SWP"));
+    }
+#endif  /* MAP_PAGING */
+
     DrawFullscreenText(EXIT_TEXT_PAGE);
 
     exit(EXIT_SUCCESS);
@@ -8234,7 +9892,15 @@ static void Startup(void)
 
     enable();
 
-    miscData = malloc(35000U);
+#ifdef SPRITE_FLAGS
+    InitializeSpriteFlags();
+
+#endif  /* SPRITE_FLAGS */
+#ifdef SPECTATOR_RELAY
+    OpenRelayPort();
+
+#endif  /* SPECTATOR_RELAY */
+    miscData = PROCESS_MALLOC(35000U);
 
     DrawFullscreenImage(IMAGE_PRETITLE);
 
@@ -8246,19 +9912,19 @@ static void Startup(void)
 
     InitializeBackdropTable();
 
-    maskedTileData = malloc(40000U);
+    maskedTileData = PROCESS_MALLOC(40000U);
 
-    soundData1 = malloc((word)GroupEntryLength("SOUNDS.MNI"));
-    soundData2 = malloc((word)GroupEntryLength("SOUNDS2.MNI"));
-    soundData3 = malloc((word)GroupEntryLength("SOUNDS3.MNI"));
+    soundData1 = PROCESS_MALLOC((word)GroupEntryLength("SOUNDS.MNI"));
+    soundData2 = PROCESS_MALLOC((word)GroupEntryLength("SOUNDS2.MNI"));
+    soundData3 = PROCESS_MALLOC((word)GroupEntryLength("SOUNDS3.MNI"));
 
     LoadSoundData("SOUNDS.MNI",  soundData1, 0);
     LoadSoundData("SOUNDS2.MNI", soundData2, 23);
     LoadSoundData("SOUNDS3.MNI", soundData3, 46);
 
-    playerTileData = malloc((word)GroupEntryLength("PLAYERS.MNI"));
+    playerTileData = PROCESS_MALLOC((word)GroupEntryLength("PLAYERS.MNI"));
 
-    mapData.b = malloc(WORD_MAX);
+    mapData.b = PROCESS_MALLOC(WORD_MAX);
 
     /*
     16-bit nightmare here. Each actor data chunk is limited to 65,535 bytes,
@@ -8267,9 +9933,9 @@ static void Startup(void)
     yourself asking "hey, what happens if there aren't two-and-a-bit chunks
     worth of data in the file" you get a shiny gold star.
     */
-    actorTileData[0] = malloc(WORD_MAX);
-    actorTileData[1] = malloc(WORD_MAX);
-    actorTileData[2] = malloc((word)GroupEntryLength("ACTORS.MNI") + 2);
+    actorTileData[0] = PROCESS_MALLOC(WORD_MAX);
+    actorTileData[1] = PROCESS_MALLOC(WORD_MAX);
+    actorTileData[2] = PROCESS_MALLOC((word)GroupEntryLength("ACTORS.MNI") + 2);
 
     LoadGroupEntryData("STATUS.MNI", actorTileData[0], 7296);
     CopyTilesToEGA(actorTileData[0], 7296 / 4, EGA_OFFSET_STATUS_TILES);
@@ -8281,23 +9947,29 @@ static void Startup(void)
 
     LoadGroupEntryData("PLAYERS.MNI", playerTileData, (word)GroupEntryLength("PLAYERS.MNI"));
 
-    actorInfoData = malloc((word)GroupEntryLength("ACTRINFO.MNI"));
+    actorInfoData = PROCESS_MALLOC((word)GroupEntryLength("ACTRINFO.MNI"));
     LoadInfoData("ACTRINFO.MNI", actorInfoData, (word)GroupEntryLength("ACTRINFO.MNI"));
 
-    playerInfoData = malloc((word)GroupEntryLength("PLYRINFO.MNI"));
+    playerInfoData = PROCESS_MALLOC((word)GroupEntryLength("PLYRINFO.MNI"));
     LoadInfoData("PLYRINFO.MNI", playerInfoData, (word)GroupEntryLength("PLYRINFO.MNI"));
 
-    cartoonInfoData = malloc((word)GroupEntryLength("CARTINFO.MNI"));
+    cartoonInfoData = PROCESS_MALLOC((word)GroupEntryLength("CARTINFO.MNI"));
     LoadInfoData("CARTINFO.MNI", cartoonInfoData, (word)GroupEntryLength("CARTINFO.MNI"));
 
-    fontTileData = malloc(4000);
+    fontTileData = PROCESS_MALLOC(4000);
     LoadFontTileData("FONTS.MNI", fontTileData, 4000);
 
     if (isAdLibPresent) {
-        tileAttributeData = malloc(7000);
+        tileAttributeData = PROCESS_MALLOC(7000);
         LoadTileAttributeData("TILEATTR.MNI");
     }
 
+#if defined(MEMORY_ARENAS) && defined(LEVEL_RESTART)
+    /* If this fails, the level image never gets allocated and isn't used */
+    levelArena.base = PROCESS_MALLOC(MEMORY_ARENAS);
+    levelArena.size = MEMORY_ARENAS;
+
+#endif  /* MEMORY_ARENAS && LEVEL_RESTART */
     totalMemFreeAfter = coreleft();
 
     ClearScreen();
@@ -8305,6 +9977,10 @@ static void Startup(void)
     ShowCopyright();
 
     isJoystickReady = false;
+#ifdef QUICK_JOYSTICK
+    /* With no joystick there, a saved calibration would lock out the keyboard */
+    if (IsJoystickCalibrationUsable()) isJoystickReady = true;
+#endif  /* QUICK_JOYSTICK */
 }
 
 /*
@@ -8317,6 +9993,10 @@ static void ClearGameScreen(void)
 
     SelectDrawPage(1);
     DrawStaticGameScreen();
+
+#ifdef LAZY_STATUS_BAR
+    FlushStatusBar();
+#endif  /* LAZY_STATUS_BAR */
 }
 
 /*
@@ -8437,11 +10117,19 @@ This is the hairiest function in the entire game. Best of luck to you.
 */
 static void MovePlayer(void)
 {
+#ifdef HAS_TICK_STATICS
+#   define idlecount     tickStatics.idlecount
+#   define movecount     tickStatics.movecount
+#   define bombcooldown  tickStatics.bombcooldown
+#   define playerBombDir tickStatics.bombdir
+    static int jumptable[] = {-2, -1, -1, -1, -1, -1, -1, 0, 0, 0};
+#else
     static word idlecount = 0;
     static int jumptable[] = {-2, -1, -1, -1, -1, -1, -1, 0, 0, 0};
     static word movecount = 0;
     static word bombcooldown = 0;
     static word playerBombDir;
+#endif  /* HAS_TICK_STATICS */
     word horizmove;
     register word southmove = 0;
     register bool clingslip = false;
@@ -8949,13 +10637,23 @@ static void MovePlayer(void)
         scrollX--;
     }
 }
+#ifdef HAS_TICK_STATICS
+#undef idlecount
+#undef movecount
+#undef bombcooldown
+#undef playerBombDir
+#endif  /* HAS_TICK_STATICS */
 
 /*
 Handle player movement and bomb placement while the player is riding a scooter.
 */
 static void MovePlayerScooter(void)
 {
+#ifdef HAS_TICK_STATICS
+#   define bombcooldown tickStatics.scooterbombcooldown
+#else
     static word bombcooldown = 0;
+#endif  /* HAS_TICK_STATICS */
 
     ClearPlayerDizzy();
 
@@ -9115,6 +10813,9 @@ decrement:
         scrollX--;
     }
 }
+#ifdef HAS_TICK_STATICS
+#undef bombcooldown
+#endif  /* HAS_TICK_STATICS */
 
 /*
 If the player has a head-shake queued up, perform it here.
@@ -9150,6 +10851,39 @@ static void ProcessPlayerDizzy(void)
     }
 }
 
+#ifdef LEVEL_RESTART
+/*
+Start the current level over after the player dies. This has the same effect as
+loading the temporary save file and initializing the level, but everything comes
+from memory. If the level image is unusable, that's what happens instead.
+*/
+static void RestartLevel(void)
+{
+    if (!isLevelImageValid || isMapJournalFull) {
+        LoadGameState('T');
+        InitializeLevel(levelNum);
+
+        return;
+    }
+
+    playerHealth = levelStart.health;
+    playerHealthCells = levelStart.cells;
+    playerBombs = levelStart.bombs;
+    gameScore = levelStart.score;
+    gameStars = levelStart.stars;
+    usedCheatCode = levelStart.usedcheat;
+
+    /* SaveGameState() always writes these as seen */
+    sawBombHint = true;
+    pounceHintState = POUNCE_HINT_SEEN;
+    sawHealthHint = true;
+
+    isLevelRestarting = true;
+    InitializeLevel(levelNum);
+    isLevelRestarting = false;
+}
+#endif  /* LEVEL_RESTART */
+
 /*
 Draw the player sprite, as well as any reactions to external factors. Also
 responsible for determining if the player fell off the map, and drawing the
@@ -9204,8 +10938,12 @@ static bbool ProcessAndDrawPlayer(void)
         }
 
         if (playerFallDeadTime > 30) {
+#ifdef LEVEL_RESTART
+            RestartLevel();
+#else
             LoadGameState('T');
             InitializeLevel(levelNum);
+#endif  /* LEVEL_RESTART */
             playerFallDeadTime = 0;  /* InitializeMapGlobals() already did this */
             return true;
         }
@@ -9249,8 +10987,12 @@ static bbool ProcessAndDrawPlayer(void)
         DrawPlayer(PLAYER_DEAD_1 + (playerDeadTime % 2), playerX - 1, playerY, DRAW_MODE_IN_FRONT);
 
         if (playerDeadTime > 36) {
+#ifdef LEVEL_RESTART
+            RestartLevel();
+#else
             LoadGameState('T');
             InitializeLevel(levelNum);
+#endif  /* LEVEL_RESTART */
             return true;
         }
     }
@@ -9487,6 +11229,9 @@ static bbool PromptLevelWarp(void)
     if (x >= 0 && x <= (int)(sizeof levels / sizeof levels[0]) - 1) {
         levelNum = x;  /* no effect, next two calls both clobber this */
         LoadGameState('T');
+#ifdef SPECTATOR_RELAY
+        StartRelay(levels[x]);
+#endif  /* SPECTATOR_RELAY */
         InitializeLevel(levels[x]);
 
         return true;
@@ -9499,6 +11244,9 @@ static bbool PromptLevelWarp(void)
 Display the main title screen, credits (if the user waits long enough), and
 main menu options. Returns a result byte indicating which demo mode the game
 loop should run under.
+
+#ifdef SPECTATOR_RELAY: W at the main menu watches a game relayed from another
+computer. That runs as demo playback, with `isSpectating` set.
 */
 static byte TitleLoop(void)
 {
@@ -9586,6 +11334,12 @@ getkey:
         case SCANCODE_D:
             InitializeEpisode();
             return DEMO_STATE_PLAY;
+#ifdef SPECTATOR_RELAY
+        case SCANCODE_W:
+            InitializeEpisode();
+            isSpectating = true;
+            return DEMO_STATE_PLAY;
+#endif  /* SPECTATOR_RELAY */
         case SCANCODE_T:
             goto title;
         case SCANCODE_Q:
@@ -9649,6 +11403,9 @@ static byte ShowHelpMenu(void)
             {  /* for scope */
                 byte result = PromptRestoreGame();
                 if (result == RESTORE_GAME_SUCCESS) {
+#ifdef SPECTATOR_RELAY
+                    StartRelay(levelNum);
+#endif  /* SPECTATOR_RELAY */
                     InitializeLevel(levelNum);
                     return HELP_MENU_RESTART;
                 } else if (result == RESTORE_GAME_NOT_FOUND) {
@@ -9670,929 +11427,3781 @@ static byte ShowHelpMenu(void)
     }
 }
 
+#ifdef DEMO_STREAM
 /*
-Read the next byte of demo data into the global command variables. Return true
-if the end of the demo data has been reached, otherwise return false.
+Number of recorded ticks between forced commits of the demo stream to disk.
 */
-static bbool ReadDemoFrame(void)
-{
-    cmdWest  = (bbool)(*(miscData + demoDataPos) & 0x01);
-    cmdEast  = (bbool)(*(miscData + demoDataPos) & 0x02);
-    cmdNorth = (bbool)(*(miscData + demoDataPos) & 0x04);
-    cmdSouth = (bbool)(*(miscData + demoDataPos) & 0x08);
-    cmdJump  = (bbool)(*(miscData + demoDataPos) & 0x10);
-    cmdBomb  = (bbool)(*(miscData + demoDataPos) & 0x20);
-    winLevel =  (bool)(*(miscData + demoDataPos) & 0x40);
-
-    demoDataPos++;
+#define DEMO_COMMIT_TICKS 100
 
-    if (demoDataPos > demoDataLength) return true;
+/*
+Append `value` to `fp` (usually the demo stream), seven bits at a time, low bits
+first. Every byte except the last has its high bit set.
+*/
+static void WriteVarint(FILE *fp, word value)
+{
+    while (value >= 0x80) {
+        fputc((value & 0x7f) | 0x80, fp);
+        value >>= 7;
+    }
 
-    return false;
+    fputc(value, fp);
 }
 
 /*
-Pack the current state of all the global command variables into a byte, then
-append that byte to the demo data. Return true if the demo data storage is full,
-otherwise return false.
+Read a value written by WriteVarint() from `fp`.
 */
-static bbool WriteDemoFrame(void)
+static word ReadVarint(FILE *fp)
 {
-    if (demoDataLength > 4998) return true;
-
-    /*
-    This function runs early enough in the game loop that this assignment
-    doesn't change the behavior of any player/actor touch.
-    */
-    winLevel = isKeyDown[SCANCODE_X];
+    word value = 0;
+    word shift = 0;
+    int c;
 
-    *(miscData + demoDataPos) = cmdWest | (cmdEast  << 1) | (cmdNorth << 2) |
-        (cmdSouth << 3) | (cmdJump  << 4) | (cmdBomb  << 5) | (winLevel << 6);
+    do {
+        c = fgetc(fp);
+        if (c == EOF) return 0;
 
-    demoDataPos++;
-    demoDataLength++;
+        value |= (word)(c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
 
-    return false;
+    return value;
 }
 
 /*
-Flush the recorded demo data to disk.
+Write out the command run that's been accumulating, if there is one.
 */
-static void SaveDemoData(void)
+static void EndDemoRun(void)
 {
-    FILE *fp = fopen("PREVDEMO.MNI", "wb");
-    miscDataContents = IMAGE_DEMO;
-
-    putw(demoDataLength, fp);
-    fwrite(miscData, demoDataLength, 1, fp);
+    if (demoRunLength == 0) return;
 
-    fclose(fp);
+    fputc(demoRunCmd, demoStream);
+    WriteVarint(demoStream, demoRunLength);
+    demoRunLength = 0;
 }
 
 /*
-Read demo data into memory.
+Push everything written so far all the way to the disk. Closing a duplicate of
+the file handle makes DOS update the directory entry, so the data survives even
+if the program never gets around to closing the file.
 */
-static void LoadDemoData(void)
+static void CommitDemoStream(void)
 {
-    FILE *fp = GroupEntryFp("PREVDEMO.MNI");
-    miscDataContents = IMAGE_DEMO;
-
-    if (fp == NULL) {
-        /* These were already set in InitializeEpisode() */
-        demoDataLength = 0;
-        demoDataPos = 0;
-    } else {
-        demoDataLength = getw(fp);
-        fread(miscData, demoDataLength, 1, fp);
-    }
-
-    fclose(fp);
+    fflush(demoStream);
+    close(dup(fileno(demoStream)));
 }
 
+#ifdef DEMO_DESYNC_CHECK
 /*
-Read the state of the keyboard/joystick for the next iteration of the game loop.
+Values recorded verbatim in each demo hash record, for a readable report.
+*/
+static struct {
+    char *name;
+    word *value;
+} desyncFields[] = {
+    {"levelNum", &levelNum}, {"playerX", &playerX}, {"playerY", &playerY},
+    {"scrollX", &scrollX}, {"scrollY", &scrollY}, {"playerHealth", &playerHealth},
+    {"playerHealthCells", &playerHealthCells}, {"playerBombs", &playerBombs},
+    {"numActors", &numActors}, {"randStepCount", &randStepCount}
+};
+#define NUM_DESYNC_FIELDS (sizeof desyncFields / sizeof desyncFields[0])
 
-Returns a result byte that indicates if the game should end or if a level change
-is needed.
+/*
+Names of the hashes computed by HashGameState(), in order.
 */
-byte ProcessGameInput(byte demo_state)
+static char *desyncHashNames[] = {"player state", "actors", "objects", "map"};
+#define NUM_DESYNC_HASHES 4
+
+/*
+Size of a demo hash record: tick, verbatim fields, and hashes.
+*/
+#define DESYNC_RECORD_SIZE (4 + (NUM_DESYNC_FIELDS * 2) + (NUM_DESYNC_HASHES * 4))
+
+/*
+Fold `length` bytes at `data` into a running Fletcher-style hash.
+*/
+static dword HashBytes(dword hash, void *data, word length)
 {
-    if (demo_state != DEMO_STATE_PLAY) {
-        if (
-            isKeyDown[SCANCODE_TAB] && isKeyDown[SCANCODE_F12] &&
-            isKeyDown[SCANCODE_KP_DOT]  /* Del */
-        ) {
-            isDebugMode = !isDebugMode;
-            StartSound(SND_PAUSE_GAME);
-            WaitHard(90);
-        }
+    register word lo = (word)hash;
+    register word hi = (word)(hash >> 16);
+    byte *src = data;
 
-        if (isKeyDown[SCANCODE_F10] && isDebugMode) {
-            if (isKeyDown[SCANCODE_G]) {
-                ToggleGodMode();
-            }
+    while (length-- != 0) {
+        lo += *src++;
+        hi += lo;
+    }
 
-            if (isKeyDown[SCANCODE_W]) {
-                if (PromptLevelWarp()) return GAME_INPUT_RESTART;
-            }
+    return ((dword)hi << 16) | lo;
+}
 
-            if (isKeyDown[SCANCODE_P]) {
-                StartSound(SND_PAUSE_GAME);
-                while (isKeyDown[SCANCODE_P])
-                    ;  /* VOID */
-                while (!isKeyDown[SCANCODE_P])
-                    ;  /* VOID */
-                while (isKeyDown[SCANCODE_P])
-                    ;  /* VOID */
-            }
+#define HASH_VAR(hash, var) hash = HashBytes(hash, &(var), sizeof (var))
 
-            if (isKeyDown[SCANCODE_M]) {
-                ShowMemoryUsage();
-            }
+/*
+Hash the simulation state into `hashes` (see `desyncHashNames`).
+*/
+static void HashGameState(dword *hashes)
+{
+    dword h = 0;
+    word i;
 
-            if (isKeyDown[SCANCODE_E] && isKeyDown[SCANCODE_N] && isKeyDown[SCANCODE_D]) {
-                winGame = true;
-            }
-        }
+    HASH_VAR(h, gameScore);
+    HASH_VAR(h, gameStars);
+    HASH_VAR(h, playerFaceDir);
+    HASH_VAR(h, playerBaseFrame);
+    HASH_VAR(h, playerFrame);
+    HASH_VAR(h, playerPushForceFrame);
+    HASH_VAR(h, playerClingDir);
+    HASH_VAR(h, playerRecoilLeft);
+    HASH_VAR(h, isPlayerLongJumping);
+    HASH_VAR(h, isPlayerRecoiling);
+    HASH_VAR(h, isPlayerSlidingEast);
+    HASH_VAR(h, isPlayerSlidingWest);
+    HASH_VAR(h, isPlayerFalling);
+    HASH_VAR(h, playerFallTime);
+    HASH_VAR(h, playerJumpTime);
+    HASH_VAR(h, playerPushDir);
+    HASH_VAR(h, playerPushTime);
+    HASH_VAR(h, playerHurtCooldown);
+    HASH_VAR(h, playerDeadTime);
+    HASH_VAR(h, scooterMounted);
+    HASH_VAR(h, playerDizzyLeft);
+#ifdef RNG_CONTEXT
+    HASH_VAR(h, randomState);
+#endif  /* RNG_CONTEXT */
+#ifdef HAS_TICK_STATICS
+    HASH_VAR(h, tickStatics.lightningstate);
+    HASH_VAR(h, tickStatics.lastrecoil);
+    HASH_VAR(h, tickStatics.idlecount);
+    HASH_VAR(h, tickStatics.movecount);
+    HASH_VAR(h, tickStatics.bombcooldown);
+    HASH_VAR(h, tickStatics.bombdir);
+    HASH_VAR(h, tickStatics.scooterbombcooldown);
+#endif  /* HAS_TICK_STATICS */
+    hashes[0] = h;
 
-        if (
-            isKeyDown[SCANCODE_C] && isKeyDown[SCANCODE_0] && isKeyDown[SCANCODE_F10] &&
-            !usedCheatCode
-        ) {
-            StartSound(SND_PAUSE_GAME);
-            usedCheatCode = true;
-            ShowCheatMessage();
-            playerHealthCells = 5;
-            playerBombs = 9;
-            sawBombHint = true;
-            playerHealth = 6;
-            UpdateBombs();
-            UpdateHealth();
-        }
+    /*
+    Structs are hashed field by field. Tick function pointers and padding bytes
+    change from one build to the next, and would make every recorded hash
+    differ when a demo is played back with a rebuilt game.
+    */
+    h = 0;
+    for (i = 0; i < numActors; i++) {
+        Actor *act = actors + i;
+
+        HASH_VAR(h, act->sprite);
+        HASH_VAR(h, act->frame);
+        HASH_VAR(h, act->x);
+        HASH_VAR(h, act->y);
+        HASH_VAR(h, act->forceactive);
+        HASH_VAR(h, act->stayactive);
+        HASH_VAR(h, act->acrophile);
+        HASH_VAR(h, act->weighted);
+        HASH_VAR(h, act->westfree);
+        HASH_VAR(h, act->eastfree);
+        HASH_VAR(h, act->data1);
+        HASH_VAR(h, act->data2);
+        HASH_VAR(h, act->data3);
+        HASH_VAR(h, act->data4);
+        HASH_VAR(h, act->data5);
+        HASH_VAR(h, act->dead);
+        HASH_VAR(h, act->falltime);
+        HASH_VAR(h, act->hurtcooldown);
+    }
+    hashes[1] = h;
+
+    h = 0;
+    for (i = 0; i < numPlatforms; i++) {
+        HASH_VAR(h, platforms[i].x);
+        HASH_VAR(h, platforms[i].y);
+        HASH_VAR(h, platforms[i].mapstash);
+    }
+    h = HashBytes(h, fountains, numFountains * sizeof(Fountain));
+    for (i = 0; i < MAX_SHARDS; i++) {
+        HASH_VAR(h, shards[i].sprite);
+        HASH_VAR(h, shards[i].x);
+        HASH_VAR(h, shards[i].y);
+        HASH_VAR(h, shards[i].frame);
+        HASH_VAR(h, shards[i].age);
+        HASH_VAR(h, shards[i].xmode);
+        HASH_VAR(h, shards[i].bounced);
+    }
+    HASH_VAR(h, explosions);
+    HASH_VAR(h, spawners);
+    for (i = 0; i < MAX_DECORATIONS; i++) {
+        HASH_VAR(h, decorations[i].alive);
+        HASH_VAR(h, decorations[i].sprite);
+        HASH_VAR(h, decorations[i].numframes);
+        HASH_VAR(h, decorations[i].x);
+        HASH_VAR(h, decorations[i].y);
+        HASH_VAR(h, decorations[i].dir);
+        HASH_VAR(h, decorations[i].numtimes);
+    }
+    HASH_VAR(h, decorationFrame);
+    hashes[2] = h;
+
+#ifdef MAP_CHANGE_LOG
+    HashMapChanges();
+#endif  /* MAP_CHANGE_LOG */
+    hashes[3] = mapHash;
+}
+
+/*
+Fill `record` with a hash record (DESYNC_RECORD_SIZE bytes) that describes the
+current game state.
+*/
+static void BuildDemoHash(word *record)
+{
+    dword hashes[NUM_DESYNC_HASHES];
+    word i;
 
-        if (isKeyDown[SCANCODE_S]) {
-            ToggleSound();
-        } else if (isKeyDown[SCANCODE_M]) {
-            ToggleMusic();
-        } else if (isKeyDown[SCANCODE_ESC] || isKeyDown[SCANCODE_Q]) {
-            if (PromptQuitConfirm()) return GAME_INPUT_QUIT;
-        } else if (isKeyDown[SCANCODE_F1]) {
-            byte result = ShowHelpMenu();
-            if (result == HELP_MENU_RESTART) {
-                return GAME_INPUT_RESTART;
-            } else if (result == HELP_MENU_QUIT) {
-                if (PromptQuitConfirm()) return GAME_INPUT_QUIT;
-            }
-        } else if (isKeyDown[SCANCODE_P]) {
-            StartSound(SND_PAUSE_GAME);
-            ShowPauseMessage();
-        }
-    } else if ((inportb(0x0060) & 0x80) == 0) {
-        return GAME_INPUT_QUIT;
+    HashGameState(hashes);
+
+    *record++ = (word)demoTick;
+    *record++ = (word)(demoTick >> 16);
+
+    for (i = 0; i < NUM_DESYNC_FIELDS; i++) {
+        *record++ = *desyncFields[i].value;
     }
 
-    if (demo_state != DEMO_STATE_PLAY) {
-        if (!isJoystickReady) {
-            cmdWest  = isKeyDown[scancodeWest] >> blockMovementCmds;
-            cmdEast  = isKeyDown[scancodeEast] >> blockMovementCmds;
-            cmdJump  = isKeyDown[scancodeJump] >> blockMovementCmds;
-            cmdNorth = isKeyDown[scancodeNorth];
-            cmdSouth = isKeyDown[scancodeSouth];
-            cmdBomb  = isKeyDown[scancodeBomb];
-        } else {
-            /* Returned state is not important; all global cmds get set. */
-            ReadJoystickState(JOYSTICK_A);
-        }
+    for (i = 0; i < NUM_DESYNC_HASHES; i++) {
+        *record++ = (word)hashes[i];
+        *record++ = (word)(hashes[i] >> 16);
+    }
+}
 
-        if (blockActionCmds) {
-            cmdNorth = cmdSouth = cmdBomb = false;
+/*
+Append a hash record describing the current game state to the demo stream.
+*/
+static void WriteDemoHash(void)
+{
+    word record[DESYNC_RECORD_SIZE / 2];
+
+    BuildDemoHash(record);
+
+    fputc(DEMO_TAG_HASH, demoStream);
+    WriteVarint(demoStream, DESYNC_RECORD_SIZE);
+    fwrite(record, DESYNC_RECORD_SIZE, 1, demoStream);
+}
+
+/*
+Compare a hash record made by BuildDemoHash() against the current game state.
+The first time anything differs, write a report listing everything that does to
+DESYNC.TXT.
+*/
+static void CompareDemoHash(word *record)
+{
+    dword hashes[NUM_DESYNC_HASHES];
+    dword rtick, rhash;
+    word *rvalues;
+    word i;
+    bool differs;
+    FILE *fp;
+
+    if (isDesyncReported) return;
+
+    HashGameState(hashes);
+
+    rtick = *record | ((dword)*(record + 1) << 16);
+    differs = rtick != demoTick;
+
+    rvalues = record + 2;
+    for (i = 0; i < NUM_DESYNC_FIELDS; i++) {
+        if (rvalues[i] != *desyncFields[i].value) differs = true;
+    }
+
+    for (i = 0; i < NUM_DESYNC_HASHES; i++) {
+        rhash = *(rvalues + NUM_DESYNC_FIELDS + (i * 2));
+        rhash |= (dword)*(rvalues + NUM_DESYNC_FIELDS + (i * 2) + 1) << 16;
+
+        if (rhash != hashes[i]) differs = true;
+
+        /* Stash the recorded hash for the report; the actual one isn't needed */
+        hashes[i] ^= rhash;
+    }
+
+    if (!differs) return;
+
+    isDesyncReported = true;
+
+    fp = fopen("DESYNC.TXT", "w");
+    if (fp == NULL) return;
+
+    fprintf(fp, "Demo desync at tick %lu (recorded as tick %lu)\n", demoTick, rtick);
+
+    for (i = 0; i < NUM_DESYNC_FIELDS; i++) {
+        if (rvalues[i] != *desyncFields[i].value) {
+            fprintf(fp, "%s: recorded %u, now %u\n",
+                desyncFields[i].name, rvalues[i], *desyncFields[i].value
+            );
         }
+    }
 
-        if (demo_state == DEMO_STATE_RECORD) {
-            if (WriteDemoFrame()) return GAME_INPUT_QUIT;
+    for (i = 0; i < NUM_DESYNC_HASHES; i++) {
+        if (hashes[i] != 0) {
+            fprintf(fp, "%s: hash differs\n", desyncHashNames[i]);
         }
-    } else if (ReadDemoFrame()) {
-        return GAME_INPUT_QUIT;
     }
 
-    return GAME_INPUT_CONTINUE;
+    fclose(fp);
 }
 
 /*
-Draw the "Super Star Bonus" screen, deduct from the star count, and add to the
-player's score.
+Read a hash record of `size` bytes from the demo stream and compare it against
+the current game state.
 */
-void ShowStarBonus(void)
+static void CheckDemoHash(word size)
 {
-    register word stars;
-    word i = 0;
+    word record[DESYNC_RECORD_SIZE / 2];
 
-    StopMusic();
+    if (isDesyncReported || size != DESYNC_RECORD_SIZE) {
+        fseek(demoStream, size, SEEK_CUR);
 
-    if (gameStars == 0) {
-        /* Fade-out is not necessary; every caller fades after this returns. */
-        FadeOut();
         return;
     }
 
-    FadeWhiteCustom(3);
-    SelectDrawPage(0);
-    SelectActivePage(0);
-    ClearScreen();
+    fread(record, DESYNC_RECORD_SIZE, 1, demoStream);
+    CompareDemoHash(record);
+}
+#endif  /* DEMO_DESYNC_CHECK */
 
-    UnfoldTextFrame(2, 14, 30, "Super Star Bonus!!!!", "");
-    DrawSprite(SPR_STAR, 2, 8, 8, DRAW_MODE_ABSOLUTE);
-    DrawTextLine(14, 7, "X 1000 =");
-    DrawNumberFlushRight(27, 7, gameStars * 1000);
-    WaitHard(50);  /* nothing is visible during this delay! */
-    DrawTextLine(10, 12, "YOUR SCORE =  ");
-    DrawNumberFlushRight(29, 12, gameScore);
-    FadeIn();
-    WaitHard(100);
+/*
+Create the demo stream file `filename` and write its header, which captures
+enough of the episode state to start playback at the same place.
 
-    for (stars = (word)gameStars; stars > 0; stars--) {
-        register word x;
+#ifdef HAS_TICK_STATICS: The function statics in `tickStatics` are also reset, as
+they are for playback, so that both start from the same place.
+*/
+static void StartDemoRecording(char *filename)
+{
+    demoStream = fopen(filename, "wb");
+    if (demoStream == NULL) return;
 
-        gameScore += 1000;
+#ifdef HAS_TICK_STATICS
+    memset(&tickStatics, 0, sizeof tickStatics);
+#endif  /* HAS_TICK_STATICS */
 
-        WaitHard(15);
+    demoRunLength = 0;
+    demoCommitTicks = 0;
+#ifdef DEMO_DESYNC_CHECK
+    demoTick = 0;
+#endif  /* DEMO_DESYNC_CHECK */
 
-        for (x = 0; x < 7; x++) {
-            /* Clear score area -- not strictly needed, numbers grow and are opaque */
-            DrawSpriteTile(fontTileData + FONT_BACKGROUND_GRAY, 23 + x, 12);
-        }
+    putw(DEMO_STREAM_MAGIC, demoStream);
+    putw(DEMO_STREAM_VERSION, demoStream);
+#ifdef RNG_CONTEXT
+    putw(26, demoStream);  /* size of the fields below */
+#else
+    putw(18, demoStream);  /* size of the fields below */
+#endif  /* RNG_CONTEXT */
+    putw(EPISODE, demoStream);
+    putw(levelNum, demoStream);
+    putw(playerHealth, demoStream);
+    putw(playerHealthCells, demoStream);
+    putw(playerBombs, demoStream);
+    putw((word)gameScore, demoStream);
+    putw((word)(gameScore >> 16), demoStream);
+    putw((word)gameStars, demoStream);
+    putw((word)(gameStars >> 16), demoStream);
+#ifdef RNG_CONTEXT
+    putw((word)randomState.seed, demoStream);
+    putw((word)(randomState.seed >> 16), demoStream);
+    putw(randomState.stepcount, demoStream);
+    putw(randomState.shardxmode, demoStream);
+#endif  /* RNG_CONTEXT */
+
+    CommitDemoStream();
+}
+
+/*
+Read the rest of a demo stream header (everything after the magic word) from
+`fp`. If the demo belongs to this episode, apply the state it captured and start
+streaming from `fp`. Otherwise close `fp` and leave the demo empty.
+*/
+static void StartDemoStream(FILE *fp)
+{
+    word size, episode, level;
+    dword lo;
+
+    getw(fp);  /* version; nothing to do with it yet */
+    size = getw(fp);
+    episode = getw(fp);
+    level = getw(fp);
+
+    if (episode != EPISODE || size < 18) {
+        fclose(fp);
 
-        StartSound(SND_BIG_PRIZE);
-        DrawNumberFlushRight(29, 12, gameScore);
+        return;
+    }
 
-        /* Increment i for each star collected, stopping at 78 */
-        if (i / 6 < 13) i++;
+    levelNum = level;
+    playerHealth = getw(fp);
+    playerHealthCells = getw(fp);
+    playerBombs = getw(fp);
+    lo = (word)getw(fp);
+    gameScore = lo | ((dword)(word)getw(fp) << 16);
+    lo = (word)getw(fp);
+    gameStars = lo | ((dword)(word)getw(fp) << 16);
 
-        for (x = 0; x < 16; x++) {
-            if (x < 7) {
-                /* Clear x1000 area -- needed as the number of digits shrinks */
-                DrawSpriteTile(fontTileData + FONT_BACKGROUND_GRAY, 22 + x, 7);
-            }
+#ifdef RNG_CONTEXT
+    if (size >= 26) {
+        lo = (word)getw(fp);
+        randomState.seed = lo | ((dword)(word)getw(fp) << 16);
+        randomState.stepcount = getw(fp);
+        randomState.shardxmode = getw(fp);
+        size -= 8;
+    }
 
-            if (i % 8 == 1) {
-                /* Clear rank area -- needed because letter chars have transparency */
-                DrawSpriteTile(fontTileData + FONT_BACKGROUND_GRAY, 13 + x, 14);
-            }
-        }
+#endif  /* RNG_CONTEXT */
+    /* Skip any header fields added by later versions */
+    fseek(fp, size - 18, SEEK_CUR);
 
-        DrawNumberFlushRight(27, 7, (stars - 1) * 1000L);
+    demoStream = fp;
+    demoRunLength = 0;
+#ifdef DEMO_DESYNC_CHECK
+    demoTick = 0;
+    isDesyncReported = false;
+#endif  /* DEMO_DESYNC_CHECK */
+#ifdef HAS_TICK_STATICS
+    memset(&tickStatics, 0, sizeof tickStatics);
+#endif  /* HAS_TICK_STATICS */
+}
 
-        /*
-        BUG: Due to differences in division (6 vs. 8), "Radical!", "Incredible",
-        and "Towering" never display in the game.
+/*
+Read the next tick of commands from the demo stream into the global command
+variables. Return true if the end of the stream has been reached.
+*/
+static bbool ReadDemoStreamFrame(void)
+{
+    while (demoRunLength == 0) {
+        int c = fgetc(demoStream);
 
-        NOTE: If the player collected 78 or more stars, `i / 6` indexes past the
-        end of `starBonusRanks[]`. This doesn't cause trouble because `i` is
-        capped at 78, and 78 % 8 is never 1.
-        */
-        if (i % 8 == 1) {
-            DrawTextLine(13, 14, starBonusRanks[i / 6]);
+        if (c == EOF || c == DEMO_TAG_END) return true;
+
+#ifdef DEMO_DESYNC_CHECK
+        if (c == DEMO_TAG_HASH) {
+            CheckDemoHash(ReadVarint(demoStream));
+            continue;
         }
+
+#endif  /* DEMO_DESYNC_CHECK */
+        /* Skip over any tagged records not handled here */
+        if (c >= DEMO_TAG_FIRST) {
+            fseek(demoStream, ReadVarint(demoStream), SEEK_CUR);
+            continue;
+        }
+
+        demoRunCmd = c;
+        demoRunLength = ReadVarint(demoStream);
     }
 
-    WaitHard(400);
+    cmdWest  = (bbool)(demoRunCmd & 0x01);
+    cmdEast  = (bbool)(demoRunCmd & 0x02);
+    cmdNorth = (bbool)(demoRunCmd & 0x04);
+    cmdSouth = (bbool)(demoRunCmd & 0x08);
+    cmdJump  = (bbool)(demoRunCmd & 0x10);
+    cmdBomb  = (bbool)(demoRunCmd & 0x20);
+    winLevel =  (bool)(demoRunCmd & 0x40);
 
-    gameStars = 0;
+    demoRunLength--;
+#ifdef DEMO_DESYNC_CHECK
+    demoTick++;
+#endif  /* DEMO_DESYNC_CHECK */
+
+    return false;
 }
+#endif  /* DEMO_STREAM */
 
+#ifdef HAS_SERIAL_PORT
 /*
-Show the intermission screen that bookends every bonus stage.
+Queue `count` words from `src` to be sent through the relay, low byte first.
 */
-static void ShowSectionIntermission(char *top_text, char *bottom_text)
+static void SendRelayWords(word *src, word count)
 {
-    word x;
-
-    FadeOut();
-    SelectDrawPage(0);
-    SelectActivePage(0);
-    ClearScreen();
+    for (; count > 0; count--) {
+        SendRelayByte((byte)*src);
+        SendRelayByte(*src++ >> 8);
+    }
+}
 
-    x = UnfoldTextFrame(6, 4, 30, top_text, bottom_text);
-    FadeIn();
-    WaitSpinner(x + 27, 8);
+/*
+Return the next byte received from the relay, waiting for one if necessary.
+Returns -1 if Esc is pressed while waiting.
+*/
+static int WaitRelayByte(void)
+{
+    int c;
 
-    ShowStarBonus();
+    while ((c = ReceiveRelayByte()) == -1) {
+        if (isKeyDown[SCANCODE_ESC]) return -1;
+    }
 
-    FadeOut();
-    ClearScreen();
+    return c;
 }
 
 /*
-Handle progression to the next level.
+Receive `count` words from the relay into `dest`. Returns false if Esc is
+pressed while waiting for them.
 */
-static void NextLevel(void)
+static bbool WaitRelayWords(word *dest, word count)
 {
-    word stars = (word)gameStars;
+    int lo, hi;
 
-    if (demoState != DEMO_STATE_NONE) {
-        switch (levelNum) {
-        case 0:
-            levelNum = 13;
-            break;
-        case 13:
-            levelNum = 5;
-            break;
-        case 5:
-            levelNum = 9;
-            break;
-        case 9:
-            levelNum = 16;
-            break;
-        }
+    for (; count > 0; count--) {
+        if ((lo = WaitRelayByte()) == -1 || (hi = WaitRelayByte()) == -1) return false;
 
-        return;
+        *dest++ = lo | (hi << 8);
     }
 
-    switch (levelNum) {
-    case 2:  /* Lesser bonus levels... */
-    case 6:
-    case 10:
-    case 14:
-    case 18:
-    case 22:
-    case 26:
-        levelNum++;
-        /* FALL THROUGH */
+    return true;
+}
+#endif  /* HAS_SERIAL_PORT */
 
-    case 3:  /* Better bonus levels... */
-    case 7:
-    case 11:
-    case 15:
-    case 19:
-    case 23:
-    case 27:
-        ShowSectionIntermission("Bonus Level Completed!!", "Press ANY key.");
-        /* FALL THROUGH */
-
-    case 0:  /* First levels in each section... */
-    case 4:
-    case 8:
-    case 12:
-    case 16:
-    case 20:
-    case 24:
-        levelNum++;
-        break;
-
-    case 1:  /* Second levels in each section... */
-    case 5:
-    case 9:
-    case 13:
-    case 17:
-    case 21:
-    case 25:
-        ShowSectionIntermission("Section Completed!", "Press ANY key.");
+/*
+Give the player what the C+0+F10 cheat gives.
+*/
+static void GiveCheatItems(void)
+{
+    usedCheatCode = true;
+    playerHealthCells = 5;
+    playerBombs = 9;
+    sawBombHint = true;
+    playerHealth = 6;
+    UpdateBombs();
+    UpdateHealth();
+}
 
-        if (stars > 24) {
-            /* Fade/clear not strictly needed */
-            FadeOutCustom(0);
-            ClearScreen();
-            DrawFullscreenImage(IMAGE_BONUS);
-            StartSound(SND_BONUS_STAGE);
-            if (stars > 49) {
-                levelNum++;
-            }
-            levelNum++;
-            WaitHard(150);
-        } else {
-            levelNum += 3;
-        }
+#ifdef SPECTATOR_RELAY
+/*
+Send a DEMO_TAG_CHEAT record for one of the RELAY_CHEAT_* cheats, so spectators
+can make the same change. Does nothing unless a regular game is being played.
+*/
+static void SendRelayCheat(byte cheat)
+{
+    if (demoState != DEMO_STATE_NONE) return;
 
-        break;
-    }
+    WaitRelaySendRoom(3);
+    SendRelayByte(DEMO_TAG_CHEAT);
+    SendRelayByte(1);
+    SendRelayByte(cheat);
 }
 
 /*
-Run the game loop. This function does not return until the entire game has been
-won or the player quits.
+Send a DEMO_TAG_START record holding enough of the episode state for spectators
+to start level `level_num` at the same place. This must happen before the level
+is initialized, since that uses up random numbers. Ticks are counted from here,
+and the statics in `tickStatics` are reset just as they are when a spectator
+starts. Does nothing unless a regular game is being played.
 */
-static void GameLoop(byte demo_state)
+static void StartRelay(word level_num)
 {
-    for (;;) {
-        while (gameTickCount < 13)
-            ;  /* VOID */
+    word header[RELAY_HEADER_SIZE / 2];
 
-        gameTickCount = 0;
+    if (demoState != DEMO_STATE_NONE) return;
 
-        AnimatePalette();
+    header[0] = EPISODE;
+    header[1] = level_num;
+    header[2] = playerHealth;
+    header[3] = playerHealthCells;
+    header[4] = playerBombs;
+    header[5] = (word)gameScore;
+    header[6] = (word)(gameScore >> 16);
+    header[7] = (word)gameStars;
+    header[8] = (word)(gameStars >> 16);
+    header[9] = (word)randomState.seed;
+    header[10] = (word)(randomState.seed >> 16);
+    header[11] = randomState.stepcount;
+    header[12] = randomState.shardxmode;
 
-        {  /* for scope */
-            word result = ProcessGameInputHelper(activePage, demo_state);
-            if (result == GAME_INPUT_QUIT) return;
-            if (result == GAME_INPUT_RESTART) continue;
-        }
+    WaitRelaySendRoom(2 + RELAY_HEADER_SIZE);
+    SendRelayByte(DEMO_TAG_START);
+    SendRelayByte(RELAY_HEADER_SIZE);
+    SendRelayWords(header, RELAY_HEADER_SIZE / 2);
 
-        MovePlayer();
+    /* Spectators start with the god mode off */
+    if (isGodMode) SendRelayCheat(RELAY_CHEAT_GOD_ON);
 
-        if (scooterMounted != 0) {
-            MovePlayerScooter();
-        }
+    memset(&tickStatics, 0, sizeof tickStatics);
+    demoTick = 0;
+}
 
-        if (queuePlayerDizzy || playerDizzyLeft != 0) {
-            ProcessPlayerDizzy();
-        }
+/*
+Send the commands for this tick through the relay. Every DEMO_DESYNC_CHECK ticks
+they are preceded by a hash record of the state they apply to, unless the send
+buffer is too backed up to take it; that only makes the check less frequent. The
+commands themselves wait for room, since spectators can't do without them.
+*/
+static void WriteRelayFrame(void)
+{
+    word record[DESYNC_RECORD_SIZE / 2];
 
-        MovePlatforms();
-        MoveFountains();
-        DrawMapRegion();
+    if (
+        demoTick % DEMO_DESYNC_CHECK == 0 &&
+        RelaySendRoom() >= 2 + DESYNC_RECORD_SIZE + 1
+    ) {
+        BuildDemoHash(record);
 
-        if (ProcessAndDrawPlayer()) continue;
+        SendRelayByte(DEMO_TAG_HASH);
+        SendRelayByte(DESYNC_RECORD_SIZE);
+        SendRelayWords(record, DESYNC_RECORD_SIZE / 2);
+    }
 
-        DrawFountains();
-        MoveAndDrawActors();
-        MoveAndDrawShards();
-        MoveAndDrawSpawners();
-        DrawRandomEffects();
-        DrawExplosions();
-        MoveAndDrawDecorations();
-        DrawLights();
+    demoTick++;
 
-        if (demoState != DEMO_STATE_NONE) {
-            DrawSprite(SPR_DEMO_OVERLAY, 0, 18, 4, DRAW_MODE_ABSOLUTE);
-        }
+    WaitRelaySendRoom(1);
+    SendRelayByte(cmdWest | (cmdEast  << 1) | (cmdNorth << 2) | (cmdSouth << 3) |
+        (cmdJump  << 4) | (cmdBomb  << 5) | (winLevel << 6));
+}
 
-#ifdef DEBUG_BAR
-#define BSTR(value) ((value) ? "T" : "F")
-        {
-            char debugBar[41];
-            word x, y, southmove;
-            static word spinoff = 0;
-            bool ise, isw;
+/*
+Receive the rest of a DEMO_TAG_START record and apply it to the episode state.
+Returns false if the record doesn't fit this episode or if Esc is pressed while
+waiting for it.
+*/
+static bbool ReadRelayHeader(void)
+{
+    word header[RELAY_HEADER_SIZE / 2];
 
-            for (x = 0; x < 40; x++) {
-                DrawSpriteTile(fontTileData + FONT_BACKGROUND_GRAY, x, 0);
-                for (y = 19; y < 25; y++) {
-                    DrawSpriteTile(fontTileData + FONT_BACKGROUND_GRAY, x, y);
-                }
-            }
+    if (
+        WaitRelayByte() != RELAY_HEADER_SIZE ||
+        !WaitRelayWords(header, RELAY_HEADER_SIZE / 2) ||
+        header[0] != EPISODE
+    ) return false;
+
+    levelNum = header[1];
+    playerHealth = header[2];
+    playerHealthCells = header[3];
+    playerBombs = header[4];
+    gameScore = header[5] | ((dword)header[6] << 16);
+    gameStars = header[7] | ((dword)header[8] << 16);
+    randomState.seed = header[9] | ((dword)header[10] << 16);
+    randomState.stepcount = header[11];
+    randomState.shardxmode = header[12];
+
+    memset(&tickStatics, 0, sizeof tickStatics);
+    demoTick = 0;
+    isDesyncReported = false;
+    isGodMode = false;
 
-            /* Dump variable contents into bars at the top/bottom of the screen */
+    return true;
+}
 
-            sprintf(debugBar,
-                "E%uL%02u PX=%04u PY=%04u SX=%04u SY=%04u",
-                EPISODE, levelNum, playerX, playerY, scrollX, scrollY
-            );
-            DrawTextLine(0, 0, debugBar);
-            sprintf(debugBar,
-                "Score=%07lu Health=%d:%u Bomb=%u Star=%02lu",
-                gameScore, playerHealth - 1, playerHealthCells, playerBombs, gameStars
-            );
-            DrawTextLine(0, 19, debugBar);
-            sprintf(debugBar,
-                "CJ=%s CJL=%s iR=%s iLJ=%s JT=%u RL=%02u PS=%u",
-                BSTR(cmdJump), BSTR(cmdJumpLatch), BSTR(isPlayerRecoiling), BSTR(isPlayerLongJumping),
-                playerJumpTime, playerRecoilLeft, pounceStreak
-            );
-            DrawTextLine(0, 21, debugBar);
-            sprintf(debugBar,
-                "iF=%s FT=%02d QD=%s DL=%u HC=%02u DT=%02u FDT=%02u",
-                BSTR(isPlayerFalling), playerFallTime, BSTR(queuePlayerDizzy),
-                playerDizzyLeft, playerHurtCooldown, playerDeadTime, playerFallDeadTime
-            );
-            DrawTextLine(0, 22, debugBar);
-            southmove = TestPlayerMove(DIR4_SOUTH, playerX, playerY + 1);
-            ise = isPlayerSlidingEast;
-            isw = isPlayerSlidingWest;
-            sprintf(debugBar,
-                "NSWE=%u%u%u%u iSE=%s iSW=%s bAbM=%s%s cC=%s CD=%u",
-                TestPlayerMove(DIR4_NORTH, playerX, playerY - 1),
-                southmove,
-                TestPlayerMove(DIR4_WEST, playerX - 1, playerY),
-                TestPlayerMove(DIR4_EAST, playerX + 1, playerY),
-                BSTR(ise), BSTR(isw), BSTR(blockActionCmds), BSTR(blockMovementCmds),
-                BSTR(canPlayerCling), playerClingDir
-            );
-            DrawTextLine(0, 23, debugBar);
+/*
+Wait for the relaying game to start (or be restored), and apply the state it
+sends. Anything received before that is passed over. Returns false, and stops
+spectating, if Esc is pressed first.
+*/
+static bbool StartSpectating(void)
+{
+    int c;
 
-            spinoff += 8;
-            if (spinoff >= 4 * 8) spinoff = 0;
-            EGA_MODE_LATCHED_WRITE();
-            DrawSolidTile(TILE_WAIT_SPINNER_1 + spinoff, 39 + (0 * 320));
-        }
-#undef BSTR
-#endif  /* DEBUG_BAR */
+    UnfoldTextFrame(5, 4, 28, "Waiting for a game...", "Press ESC to cancel.");
 
-        SelectDrawPage(activePage);
-        activePage = !activePage;
-        SelectActivePage(activePage);
+    for (;;) {
+        c = WaitRelayByte();
 
-        if (pounceHintState == POUNCE_HINT_QUEUED) {
-            pounceHintState = POUNCE_HINT_SEEN;
-            ShowPounceHint();
-        }
+        if (c == -1) break;
 
-        if (winLevel) {
-            winLevel = false;
-            StartSound(SND_WIN_LEVEL);
-            NextLevel();
-            InitializeLevel(levelNum);
-        } else if (winGame) {
-            break;
+        if (c == DEMO_TAG_START) {
+            if (ReadRelayHeader()) return true;
+            if (isKeyDown[SCANCODE_ESC]) break;
         }
     }
 
-    ShowEnding();
+    isSpectating = false;
+
+    return false;
 }
 
 /*
-Insert either a regular actor or a special actor into the world. The map format
-reserves types 0..31 for special actors, and map types 31+ become regular actors
-starting from type 0. (Map actor type 31 has overlapping branch coverage, but as
-a special actor it is a no-op due to no matching switch case.)
-
-The caller must provide the index for regular actors, which is convoluted.
+Read the next tick of commands from the relay into the global command variables,
+waiting for them to arrive if necessary. Hash records are checked along the way.
+Returns a result byte for ProcessGameInput() to pass on: the game ends when the
+relaying game does (or Esc is pressed), and restarts when it is restored.
 */
-static void NewMapActorAtIndex(
-    word index, word map_actor_type, word x_origin, word y_origin
-) {
-    if (map_actor_type < 32) {
-        switch (map_actor_type) {
-        case SPA_PLAYER_START:
-            if (x_origin > mapWidth - 15) {
-                scrollX = mapWidth - SCROLLW;
-            } else if ((int)x_origin - 15 >= 0 && mapYPower > 5) {
-                scrollX = x_origin - 15;
-            } else {
-                scrollX = 0;
-            }
-
-            if ((int)y_origin - 10 >= 0) {
-                scrollY = y_origin - 10;
-            } else {
-                scrollY = 0;
-            }
-
-            playerX = x_origin;
-            playerY = y_origin;
+static byte ReadRelayFrame(void)
+{
+    word record[DESYNC_RECORD_SIZE / 2];
+    int c;
 
-            break;
+    for (;;) {
+        c = WaitRelayByte();
 
-        case SPA_PLATFORM:
-            platforms[numPlatforms].x = x_origin;
-            platforms[numPlatforms].y = y_origin;
-            numPlatforms++;
+        if (c == -1 || c == DEMO_TAG_END) return GAME_INPUT_QUIT;
 
-            break;
+        if (c == DEMO_TAG_HASH) {
+            if (
+                WaitRelayByte() != DESYNC_RECORD_SIZE ||
+                !WaitRelayWords(record, DESYNC_RECORD_SIZE / 2)
+            ) return GAME_INPUT_QUIT;
 
-        case SPA_FOUNTAIN_SMALL:
-        case SPA_FOUNTAIN_MEDIUM:
-        case SPA_FOUNTAIN_LARGE:
-        case SPA_FOUNTAIN_HUGE:
-            fountains[numFountains].x = x_origin - 1;
-            fountains[numFountains].y = y_origin - 1;
-            fountains[numFountains].dir = DIR4_NORTH;
-            fountains[numFountains].stepcount = 0;
-            fountains[numFountains].height = 0;
-            fountains[numFountains].stepmax = map_actor_type * 3;
-            fountains[numFountains].delayleft = 0;
-            numFountains++;
+            CompareDemoHash(record);
+        } else if (c == DEMO_TAG_CHEAT) {
+            int cheat;
 
-            break;
+            if (
+                WaitRelayByte() != 1 || (cheat = WaitRelayByte()) == -1
+            ) return GAME_INPUT_QUIT;
 
-        case SPA_LIGHT_WEST:
-        case SPA_LIGHT_MIDDLE:
-        case SPA_LIGHT_EAST:
-            if (numLights == MAX_LIGHTS - 1) break;
+            if (cheat == RELAY_CHEAT_ITEMS) {
+                GiveCheatItems();
+            } else {
+                isGodMode = cheat == RELAY_CHEAT_GOD_ON;
+            }
+        } else if (c == DEMO_TAG_START) {
+            if (!ReadRelayHeader()) return GAME_INPUT_QUIT;
 
-            /* Normalize SPA_LIGHT_* into LIGHT_SIDE_* */
-            lights[numLights].side = map_actor_type - SPA_LIGHT_WEST;
-            lights[numLights].x = x_origin;
-            lights[numLights].y = y_origin;
-            numLights++;
+            InitializeLevel(levelNum);
 
+            return GAME_INPUT_RESTART;
+        } else if (c < DEMO_TAG_FIRST) {
             break;
         }
     }
 
-    if (map_actor_type < 31) return;
+    cmdWest  = (bbool)(c & 0x01);
+    cmdEast  = (bbool)(c & 0x02);
+    cmdNorth = (bbool)(c & 0x04);
+    cmdSouth = (bbool)(c & 0x08);
+    cmdJump  = (bbool)(c & 0x10);
+    cmdBomb  = (bbool)(c & 0x20);
+    winLevel =  (bool)(c & 0x40);
 
-    if (NewActorAtIndex(index, map_actor_type - 31, x_origin, y_origin)) {
-        numActors++;
-    }
+    demoTick++;
+
+    return GAME_INPUT_CONTINUE;
 }
+#endif  /* SPECTATOR_RELAY */
+
+#ifdef BENCHMARK
+/*
+Scripted input for the benchmark, as pairs of a command byte (packed the same
+way as demo data) and the number of ticks to hold it. North is never pressed, so
+hint globes and transporters don't stop the run.
+*/
+static byte benchmarkScript[] = {
+    0x02, 40,  /* east */
+    0x12, 12,  /* east + jump */
+    0x02, 24,
+    0x00, 6,
+    0x01, 30,  /* west */
+    0x11, 10,  /* west + jump */
+    0x08, 8,   /* south */
+    0x10, 8,   /* jump */
+    0x02, 60,
+    0x12, 16,
+    0x01, 20
+};
 
 /*
-Load data from a map file, initialize global state, and build all actors.
-
-This makes a waaay unsafe assumption about the Platform struct packing.
+Load the global command variables from the next tick of the benchmark script,
+starting over at the end. Always returns false; the script never runs out.
 */
-static void LoadMapData(word level_num)
+static bbool ReadBenchmarkFrame(void)
 {
-    word i;
-    word actorwords;
-    word t;  /* holds a map actor's *T*ype OR a *T*ile's horizontal position */
-    FILE *fp = GroupEntryFp(mapNames[level_num]);
+    byte cmd;
 
-    isCartoonDataLoaded = false;
+    if (benchmarkScriptLeft == 0) {
+        if (benchmarkScriptPos == sizeof(benchmarkScript)) benchmarkScriptPos = 0;
 
-    getw(fp);  /* skip over map flags */
+        benchmarkScriptLeft = benchmarkScript[benchmarkScriptPos + 1];
+        benchmarkScriptPos += 2;
+    }
+
+    cmd = benchmarkScript[benchmarkScriptPos - 2];
+    benchmarkScriptLeft--;
+
+    cmdWest  = (bbool)(cmd & 0x01);
+    cmdEast  = (bbool)(cmd & 0x02);
+    cmdNorth = (bbool)(cmd & 0x04);
+    cmdSouth = (bbool)(cmd & 0x08);
+    cmdJump  = (bbool)(cmd & 0x10);
+    cmdBomb  = (bbool)(cmd & 0x20);
+    winLevel = false;
+
+    return false;
+}
+#endif  /* BENCHMARK */
+
+/*
+Read the next byte of demo data into the global command variables. Return true
+if the end of the demo data has been reached, otherwise return false.
+*/
+static bbool ReadDemoFrame(void)
+{
+#ifdef BENCHMARK
+    if (isBenchmarkRunning) return ReadBenchmarkFrame();
+
+#endif  /* BENCHMARK */
+#ifdef DEMO_STREAM
+    if (demoStream != NULL) return ReadDemoStreamFrame();
+
+#endif  /* DEMO_STREAM */
+    cmdWest  = (bbool)(*(miscData + demoDataPos) & 0x01);
+    cmdEast  = (bbool)(*(miscData + demoDataPos) & 0x02);
+    cmdNorth = (bbool)(*(miscData + demoDataPos) & 0x04);
+    cmdSouth = (bbool)(*(miscData + demoDataPos) & 0x08);
+    cmdJump  = (bbool)(*(miscData + demoDataPos) & 0x10);
+    cmdBomb  = (bbool)(*(miscData + demoDataPos) & 0x20);
+    winLevel =  (bool)(*(miscData + demoDataPos) & 0x40);
+
+    demoDataPos++;
+
+    if (demoDataPos > demoDataLength) return true;
+
+    return false;
+}
+
+/*
+Pack the current state of all the global command variables into a byte, then
+append that byte to the demo data. Return true if the demo data storage is full,
+otherwise return false.
+*/
+static bbool WriteDemoFrame(void)
+{
+#ifdef DEMO_STREAM
+    byte cmd;
+
+    if (demoStream == NULL || ferror(demoStream)) return true;
+
+#ifdef DEMO_DESYNC_CHECK
+    if (demoTick % DEMO_DESYNC_CHECK == 0) {
+        /* Ending the run here puts the record right at the start of this tick */
+        EndDemoRun();
+        WriteDemoHash();
+    }
+
+    demoTick++;
+
+#endif  /* DEMO_DESYNC_CHECK */
+    winLevel = isKeyDown[SCANCODE_X];
+
+    cmd = cmdWest | (cmdEast  << 1) | (cmdNorth << 2) | (cmdSouth << 3) |
+        (cmdJump  << 4) | (cmdBomb  << 5) | (winLevel << 6);
+
+    if (demoRunLength != 0 && (cmd != demoRunCmd || demoRunLength == WORD_MAX)) {
+        EndDemoRun();
+    }
+
+    demoRunCmd = cmd;
+    demoRunLength++;
+
+    if (++demoCommitTicks >= DEMO_COMMIT_TICKS) {
+        EndDemoRun();
+        CommitDemoStream();
+        demoCommitTicks = 0;
+    }
+
+    return false;
+#else
+    if (demoDataLength > 4998) return true;
+
+    /*
+    This function runs early enough in the game loop that this assignment
+    doesn't change the behavior of any player/actor touch.
+    */
+    winLevel = isKeyDown[SCANCODE_X];
+
+    *(miscData + demoDataPos) = cmdWest | (cmdEast  << 1) | (cmdNorth << 2) |
+        (cmdSouth << 3) | (cmdJump  << 4) | (cmdBomb  << 5) | (winLevel << 6);
+
+    demoDataPos++;
+    demoDataLength++;
+
+    return false;
+#endif  /* DEMO_STREAM */
+}
+
+/*
+Flush the recorded demo data to disk.
+
+#ifdef DEMO_STREAM: Most of the data is already there; finish off the stream.
+*/
+static void SaveDemoData(void)
+{
+#ifdef DEMO_STREAM
+    if (demoStream != NULL) {
+        EndDemoRun();
+        fputc(DEMO_TAG_END, demoStream);
+        fclose(demoStream);
+        demoStream = NULL;
+    }
+#else
+    FILE *fp = fopen("PREVDEMO.MNI", "wb");
+    miscDataContents = IMAGE_DEMO;
+
+    putw(demoDataLength, fp);
+    fwrite(miscData, demoDataLength, 1, fp);
+
+    fclose(fp);
+#endif  /* DEMO_STREAM */
+}
+
+/*
+Read demo data into memory.
+
+#ifdef DEMO_STREAM: A version 2 demo is not read into memory. Its header is
+applied to the episode state, then it's read a little at a time during play.
+*/
+static void LoadDemoData(void)
+{
+    FILE *fp = GroupEntryFp("PREVDEMO.MNI");
+    miscDataContents = IMAGE_DEMO;
+
+    if (fp == NULL) {
+        /* These were already set in InitializeEpisode() */
+        demoDataLength = 0;
+        demoDataPos = 0;
+    } else {
+        demoDataLength = getw(fp);
+#ifdef DEMO_STREAM
+        if (demoDataLength == DEMO_STREAM_MAGIC) {
+            demoDataLength = 0;
+            StartDemoStream(fp);
+
+            return;
+        }
+#endif  /* DEMO_STREAM */
+        fread(miscData, demoDataLength, 1, fp);
+    }
+
+    fclose(fp);
+}
+
+#ifdef FAST_FORWARD
+/*
+Switch the game clock to one of the CLOCK_* speeds.
+*/
+static void SetClockSpeed(byte speed)
+{
+    clockSpeed = speed;
+    clockStep = speed == CLOCK_FAST ? FAST_FORWARD : 1;
+    isClockUnthrottled = speed == CLOCK_UNTHROTTLED;
+}
+#endif  /* FAST_FORWARD */
+
+/*
+Read the state of the keyboard/joystick for the next iteration of the game loop.
+
+Returns a result byte that indicates if the game should end or if a level change
+is needed.
+
+#ifdef SPECTATOR_RELAY: The commands of a regular game are also sent through the
+relay, and a spectator's commands come from there.
+#ifdef FAST_FORWARD: F9 steps to the next game clock speed, even during demos.
+Only a game that is being relayed stays at normal speed, since the relay can't
+keep up with anything faster.
+*/
+byte ProcessGameInput(byte demo_state)
+{
+#ifdef FAST_FORWARD
+    if (isKeyDown[SCANCODE_F9]) {
+#ifdef SPECTATOR_RELAY
+        if (demo_state != DEMO_STATE_NONE)
+#endif  /* SPECTATOR_RELAY */
+        SetClockSpeed((clockSpeed + 1) % NUM_CLOCK_SPEEDS);
+
+        /* Once released, the key doesn't count as a keypress that ends a demo */
+        while (isKeyDown[SCANCODE_F9])
+            ;  /* VOID */
+    }
+
+#endif  /* FAST_FORWARD */
+    if (demo_state != DEMO_STATE_PLAY) {
+        if (
+            isKeyDown[SCANCODE_TAB] && isKeyDown[SCANCODE_F12] &&
+            isKeyDown[SCANCODE_KP_DOT]  /* Del */
+        ) {
+            isDebugMode = !isDebugMode;
+            StartSound(SND_PAUSE_GAME);
+            WaitHard(90);
+        }
+
+        if (isKeyDown[SCANCODE_F10] && isDebugMode) {
+            if (isKeyDown[SCANCODE_G]) {
+                ToggleGodMode();
+#ifdef SPECTATOR_RELAY
+                SendRelayCheat(isGodMode ? RELAY_CHEAT_GOD_ON : RELAY_CHEAT_GOD_OFF);
+#endif  /* SPECTATOR_RELAY */
+            }
+
+            if (isKeyDown[SCANCODE_W]) {
+                if (PromptLevelWarp()) return GAME_INPUT_RESTART;
+            }
+
+            if (isKeyDown[SCANCODE_P]) {
+                StartSound(SND_PAUSE_GAME);
+                while (isKeyDown[SCANCODE_P])
+                    ;  /* VOID */
+                while (!isKeyDown[SCANCODE_P])
+                    ;  /* VOID */
+                while (isKeyDown[SCANCODE_P])
+                    ;  /* VOID */
+            }
+
+            if (isKeyDown[SCANCODE_M]) {
+                ShowMemoryUsage();
+            }
+
+            if (isKeyDown[SCANCODE_E] && isKeyDown[SCANCODE_N] && isKeyDown[SCANCODE_D]) {
+                winGame = true;
+            }
+        }
+
+        if (
+            isKeyDown[SCANCODE_C] && isKeyDown[SCANCODE_0] && isKeyDown[SCANCODE_F10] &&
+            !usedCheatCode
+        ) {
+            StartSound(SND_PAUSE_GAME);
+            ShowCheatMessage();
+            GiveCheatItems();
+#ifdef SPECTATOR_RELAY
+            SendRelayCheat(RELAY_CHEAT_ITEMS);
+#endif  /* SPECTATOR_RELAY */
+        }
+
+        if (isKeyDown[SCANCODE_S]) {
+            ToggleSound();
+        } else if (isKeyDown[SCANCODE_M]) {
+            ToggleMusic();
+        } else if (isKeyDown[SCANCODE_ESC] || isKeyDown[SCANCODE_Q]) {
+            if (PromptQuitConfirm()) return GAME_INPUT_QUIT;
+        } else if (isKeyDown[SCANCODE_F1]) {
+            byte result = ShowHelpMenu();
+            if (result == HELP_MENU_RESTART) {
+                return GAME_INPUT_RESTART;
+            } else if (result == HELP_MENU_QUIT) {
+                if (PromptQuitConfirm()) return GAME_INPUT_QUIT;
+            }
+        } else if (isKeyDown[SCANCODE_P]) {
+            StartSound(SND_PAUSE_GAME);
+            ShowPauseMessage();
+        }
+    } else if ((inportb(0x0060) & 0x80) == 0) {
+        return GAME_INPUT_QUIT;
+    }
+
+    if (demo_state != DEMO_STATE_PLAY) {
+        if (!isJoystickReady) {
+#ifdef INPUT_EVENTS
+            DrainInputEvents();
+
+#endif  /* INPUT_EVENTS */
+            cmdWest  = KEY_ACTIVE(scancodeWest) >> blockMovementCmds;
+            cmdEast  = KEY_ACTIVE(scancodeEast) >> blockMovementCmds;
+            cmdJump  = KEY_ACTIVE(scancodeJump) >> blockMovementCmds;
+            cmdNorth = KEY_ACTIVE(scancodeNorth);
+            cmdSouth = KEY_ACTIVE(scancodeSouth);
+            cmdBomb  = KEY_ACTIVE(scancodeBomb);
+#ifdef INPUT_EVENTS
+
+            ClearKeyLatches();
+#endif  /* INPUT_EVENTS */
+        } else {
+            /* Returned state is not important; all global cmds get set. */
+            ReadJoystickState(JOYSTICK_A);
+        }
+
+        if (blockActionCmds) {
+            cmdNorth = cmdSouth = cmdBomb = false;
+        }
+
+        if (demo_state == DEMO_STATE_RECORD) {
+            if (WriteDemoFrame()) return GAME_INPUT_QUIT;
+        }
+#ifdef SPECTATOR_RELAY
+
+        if (demo_state == DEMO_STATE_NONE) {
+            WriteRelayFrame();
+        }
+#endif  /* SPECTATOR_RELAY */
+#ifdef SPECTATOR_RELAY
+    } else if (isSpectating) {
+        return ReadRelayFrame();
+#endif  /* SPECTATOR_RELAY */
+    } else if (ReadDemoFrame()) {
+        return GAME_INPUT_QUIT;
+    }
+
+    return GAME_INPUT_CONTINUE;
+}
+
+/*
+Draw the "Super Star Bonus" screen, deduct from the star count, and add to the
+player's score.
+*/
+void ShowStarBonus(void)
+{
+    register word stars;
+    word i = 0;
+
+    StopMusic();
+
+    if (gameStars == 0) {
+        /* Fade-out is not necessary; every caller fades after this returns. */
+        FadeOut();
+        return;
+    }
+
+    FadeWhiteCustom(3);
+    SelectDrawPage(0);
+    SelectActivePage(0);
+    ClearScreen();
+
+    UnfoldTextFrame(2, 14, 30, "Super Star Bonus!!!!", "");
+    DrawSprite(SPR_STAR, 2, 8, 8, DRAW_MODE_ABSOLUTE);
+    DrawTextLine(14, 7, "X 1000 =");
+    DrawNumberFlushRight(27, 7, gameStars * 1000);
+    WaitHard(50);  /* nothing is visible during this delay! */
+    DrawTextLine(10, 12, "YOUR SCORE =  ");
+    DrawNumberFlushRight(29, 12, gameScore);
+    FadeIn();
+    WaitHard(100);
+
+    for (stars = (word)gameStars; stars > 0; stars--) {
+        register word x;
+
+        gameScore += 1000;
+
+        WaitHard(15);
+
+        for (x = 0; x < 7; x++) {
+            /* Clear score area -- not strictly needed, numbers grow and are opaque */
+            DrawSpriteTile(fontTileData + FONT_BACKGROUND_GRAY, 23 + x, 12);
+        }
+
+        StartSound(SND_BIG_PRIZE);
+        DrawNumberFlushRight(29, 12, gameScore);
+
+        /* Increment i for each star collected, stopping at 78 */
+        if (i / 6 < 13) i++;
+
+        for (x = 0; x < 16; x++) {
+            if (x < 7) {
+                /* Clear x1000 area -- needed as the number of digits shrinks */
+                DrawSpriteTile(fontTileData + FONT_BACKGROUND_GRAY, 22 + x, 7);
+            }
+
+            if (i % 8 == 1) {
+                /* Clear rank area -- needed because letter chars have transparency */
+                DrawSpriteTile(fontTileData + FONT_BACKGROUND_GRAY, 13 + x, 14);
+            }
+        }
+
+        DrawNumberFlushRight(27, 7, (stars - 1) * 1000L);
+
+        /*
+        BUG: Due to differences in division (6 vs. 8), "Radical!", "Incredible",
+        and "Towering" never display in the game.
+
+        NOTE: If the player collected 78 or more stars, `i / 6` indexes past the
+        end of `starBonusRanks[]`. This doesn't cause trouble because `i` is
+        capped at 78, and 78 % 8 is never 1.
+        */
+        if (i % 8 == 1) {
+            DrawTextLine(13, 14, starBonusRanks[i / 6]);
+        }
+    }
+
+    WaitHard(400);
+
+    gameStars = 0;
+}
+
+/*
+Show the intermission screen that bookends every bonus stage.
+*/
+static void ShowSectionIntermission(char *top_text, char *bottom_text)
+{
+    word x;
+
+    FadeOut();
+    SelectDrawPage(0);
+    SelectActivePage(0);
+    ClearScreen();
+
+    x = UnfoldTextFrame(6, 4, 30, top_text, bottom_text);
+    FadeIn();
+    WaitSpinner(x + 27, 8);
+
+    ShowStarBonus();
+
+    FadeOut();
+    ClearScreen();
+}
+
+/*
+Handle progression to the next level.
+*/
+static void NextLevel(void)
+{
+    word stars = (word)gameStars;
+
+    if (demoState != DEMO_STATE_NONE) {
+        switch (levelNum) {
+        case 0:
+            levelNum = 13;
+            break;
+        case 13:
+            levelNum = 5;
+            break;
+        case 5:
+            levelNum = 9;
+            break;
+        case 9:
+            levelNum = 16;
+            break;
+        }
+
+        return;
+    }
+
+    switch (levelNum) {
+    case 2:  /* Lesser bonus levels... */
+    case 6:
+    case 10:
+    case 14:
+    case 18:
+    case 22:
+    case 26:
+        levelNum++;
+        /* FALL THROUGH */
+
+    case 3:  /* Better bonus levels... */
+    case 7:
+    case 11:
+    case 15:
+    case 19:
+    case 23:
+    case 27:
+        ShowSectionIntermission("Bonus Level Completed!!", "Press ANY key.");
+        /* FALL THROUGH */
+
+    case 0:  /* First levels in each section... */
+    case 4:
+    case 8:
+    case 12:
+    case 16:
+    case 20:
+    case 24:
+        levelNum++;
+        break;
+
+    case 1:  /* Second levels in each section... */
+    case 5:
+    case 9:
+    case 13:
+    case 17:
+    case 21:
+    case 25:
+        ShowSectionIntermission("Section Completed!", "Press ANY key.");
+
+        if (stars > 24) {
+            /* Fade/clear not strictly needed */
+            FadeOutCustom(0);
+            ClearScreen();
+            DrawFullscreenImage(IMAGE_BONUS);
+            StartSound(SND_BONUS_STAGE);
+            if (stars > 49) {
+                levelNum++;
+            }
+            levelNum++;
+            WaitHard(150);
+        } else {
+            levelNum += 3;
+        }
+
+        break;
+    }
+}
+
+#ifdef BENCHMARK
+/*
+Mark the start of a benchmark tick, recording how long the previous one took.
+Returns true once `BENCHMARK` ticks have been recorded, otherwise false.
+*/
+static bbool BenchmarkFrame(void)
+{
+    dword now = ReadPreciseClock();
+
+    if (isBenchmarkTiming) {
+        benchmarkFrames[numBenchmarkFrames++] = now - benchmarkLastClock;
+    }
+
+    isBenchmarkTiming = true;
+    benchmarkLastClock = now;
+
+    return numBenchmarkFrames == BENCHMARK;
+}
+#endif  /* BENCHMARK */
+
+#ifdef GOLDEN_TRACE
+#define TRACE_MAGIC        0x7ace
+#define TRACE_ACTOR_FIELDS 10
+
+/*
+Global variables recorded in a trace, in order. The fields of every actor slot
+come after these.
+*/
+#define TRACE_VAR(var) {#var, &(var), sizeof (var)}
+static struct {
+    char *name;
+    void *value;
+    word size;
+} traceGlobals[] = {
+    TRACE_VAR(levelNum), TRACE_VAR(playerX), TRACE_VAR(playerY),
+    TRACE_VAR(scrollX), TRACE_VAR(scrollY), TRACE_VAR(playerFaceDir),
+    TRACE_VAR(playerFrame), TRACE_VAR(playerClingDir), TRACE_VAR(isPlayerFalling),
+    TRACE_VAR(playerFallTime), TRACE_VAR(playerJumpTime),
+    TRACE_VAR(isPlayerRecoiling), TRACE_VAR(playerRecoilLeft),
+    TRACE_VAR(isPlayerLongJumping), TRACE_VAR(playerPushDir),
+    TRACE_VAR(playerPushTime), TRACE_VAR(scooterMounted),
+    TRACE_VAR(playerDizzyLeft), TRACE_VAR(playerHurtCooldown),
+    TRACE_VAR(playerDeadTime), TRACE_VAR(playerHealth),
+    TRACE_VAR(playerHealthCells), TRACE_VAR(playerBombs), TRACE_VAR(gameScore),
+    TRACE_VAR(gameStars), TRACE_VAR(numActors), TRACE_VAR(randStepCount)
+};
+#define NUM_TRACE_GLOBALS (sizeof traceGlobals / sizeof traceGlobals[0])
+#define NUM_TRACE_FIELDS  (NUM_TRACE_GLOBALS + (MAX_ACTORS * TRACE_ACTOR_FIELDS))
+
+static char *traceActorFields[TRACE_ACTOR_FIELDS] = {
+    "sprite", "frame", "x", "y", "data1", "data2", "data3", "data4", "data5", "dead"
+};
+
+/*
+Copy the current value of every traced field into `dest`. Actor slots past the
+end of the actor list read as zero, so that leftovers in them can't differ.
+*/
+static void CollectTraceValues(dword *dest)
+{
+    word i;
+
+    for (i = 0; i < NUM_TRACE_GLOBALS; i++) {
+        if (traceGlobals[i].size == 1) {
+            *dest++ = *(byte *)traceGlobals[i].value;
+        } else if (traceGlobals[i].size == 2) {
+            *dest++ = *(word *)traceGlobals[i].value;
+        } else {
+            *dest++ = *(dword *)traceGlobals[i].value;
+        }
+    }
+
+    for (i = 0; i < numActors; i++) {
+        Actor *act = actors + i;
+
+        *dest++ = act->sprite;
+        *dest++ = act->frame;
+        *dest++ = act->x;
+        *dest++ = act->y;
+        *dest++ = act->data1;
+        *dest++ = act->data2;
+        *dest++ = act->data3;
+        *dest++ = act->data4;
+        *dest++ = act->data5;
+        *dest++ = act->dead;
+    }
+
+    memset(dest, 0, (MAX_ACTORS - numActors) * TRACE_ACTOR_FIELDS * sizeof *dest);
+}
+
+/*
+Is the passed trace field a dword? Those are written as two words.
+*/
+#define IS_TRACE_DWORD(field) ((field) < NUM_TRACE_GLOBALS && traceGlobals[field].size == 4)
+
+/*
+Put the name of the passed trace field into `dest`.
+*/
+static void TraceFieldName(word field, char *dest)
+{
+    if (field < NUM_TRACE_GLOBALS) {
+        strcpy(dest, traceGlobals[field].name);
+    } else {
+        field -= NUM_TRACE_GLOBALS;
+        sprintf(dest, "actors[%u].%s",
+            field / TRACE_ACTOR_FIELDS, traceActorFields[field % TRACE_ACTOR_FIELDS]
+        );
+    }
+}
+
+/*
+Read the next tick from the golden trace, applying the fields it changed to
+`traceGolden`. Returns false if the golden trace has no more ticks.
+
+Each tick is a list of the fields that changed since the tick before, as pairs
+of a varint distance from the previous field (plus one) and the new value. The
+list ends with a distance of zero.
+*/
+static bbool ReadTraceTick(void)
+{
+    word next = 0, gap;
+    int c = fgetc(traceFp);
+
+    if (c == EOF) return false;
+
+    ungetc(c, traceFp);
+
+    while ((gap = ReadVarint(traceFp)) != 0) {
+        next += gap;
+        if (next > NUM_TRACE_FIELDS) return false;
+
+        traceGolden[next - 1] = (word)getw(traceFp);
+        if (IS_TRACE_DWORD(next - 1)) {
+            traceGolden[next - 1] |= (dword)(word)getw(traceFp) << 16;
+        }
+    }
+
+    return true;
+}
+
+/*
+Trace the state at the start of a tick. When recording, the fields that changed
+since the previous tick get appended to the trace. When checking, the next tick
+is read from the golden trace and compared. Returns true to end the demo early,
+once a field differs or the golden trace has run out; otherwise false.
+*/
+static bbool TraceTick(void)
+{
+    word i, next = 0;
+
+    CollectTraceValues(traceNow);
+
+    if (isTraceRecording) {
+        /* `traceGolden` holds the previous tick's values while recording */
+        for (i = 0; i < NUM_TRACE_FIELDS; i++) {
+            if (traceNow[i] == traceGolden[i]) continue;
+
+            WriteVarint(traceFp, (i + 1) - next);
+            next = i + 1;
+
+            putw((word)traceNow[i], traceFp);
+            if (IS_TRACE_DWORD(i)) putw((word)(traceNow[i] >> 16), traceFp);
+
+            traceGolden[i] = traceNow[i];
+        }
+
+        WriteVarint(traceFp, 0);
+    } else {
+        if (!ReadTraceTick()) {
+            isTraceShort = true;
+
+            return true;
+        }
+
+        for (i = 0; i < NUM_TRACE_FIELDS; i++) {
+            if (traceNow[i] != traceGolden[i]) {
+                traceDiffField = i;
+
+                return true;
+            }
+        }
+    }
+
+    traceTick++;
+
+    return false;
+}
+#endif  /* GOLDEN_TRACE */
+
+#ifdef RETRACE_FLIP
+/*
+Wait for the start of the next vertical retrace. The video adapter picks up the
+page chosen by SelectActivePage() at that moment, so the page that was being
+shown can be drawn on afterwards without any of it showing up on the screen. If
+the adapter never reports a retrace, this gives up after a few game clock ticks.
+*/
+static void WaitForRetrace(void)
+{
+    word start = gameTickCount;
+
+#ifdef HAS_VIRTUAL_CLOCK
+    if (isClockUnthrottled) return;
+
+#endif  /* HAS_VIRTUAL_CLOCK */
+    while ((inportb(0x03da) & 0x08) != 0) {
+        if (gameTickCount - start > 3) return;
+    }
+
+    while ((inportb(0x03da) & 0x08) == 0) {
+        if (gameTickCount - start > 3) return;
+    }
+}
+#endif  /* RETRACE_FLIP */
+
+/*
+Run the game loop. This function does not return until the entire game has been
+won or the player quits.
+
+#ifdef BENCHMARK: Also returns once a running benchmark has taken enough ticks,
+or has finished the level.
+#ifdef GOLDEN_TRACE: Also returns once a traced demo differs from its golden
+trace.
+#ifdef HAS_VIRTUAL_CLOCK: There is no waiting between ticks while the game clock
+is unthrottled.
+#ifdef RETRACE_FLIP: Each page flip waits for the page to go up on the screen.
+*/
+static void GameLoop(byte demo_state)
+{
+#ifdef INPUT_EVENTS
+    /* Keys pressed in the menus shouldn't carry over into the game */
+    DrainInputEvents();
+    ClearKeyLatches();
+    isPressPending = false;
+
+#endif  /* INPUT_EVENTS */
+    for (;;) {
+#ifdef BENCHMARK
+        if (isBenchmarkRunning && BenchmarkFrame()) return;
+
+#endif  /* BENCHMARK */
+#ifdef HAS_VIRTUAL_CLOCK
+        if (!isClockUnthrottled)
+#endif  /* HAS_VIRTUAL_CLOCK */
+        while (gameTickCount < 13)
+            ;  /* VOID */
+
+#ifdef HAS_VIRTUAL_CLOCK
+        /*
+        A stepped clock overshoots 13, and keeping the part of that overshoot
+        that is less than one step makes the frames average 13 / `clockStep`
+        interrupts apiece. With a step of 1, this is always zero as before.
+        */
+        gameTickCount = gameTickCount < 13 ? 0 : (gameTickCount - 13) % clockStep;
+#else
+        gameTickCount = 0;
+#endif  /* HAS_VIRTUAL_CLOCK */
+
+#ifdef GOLDEN_TRACE
+        if (isTraceRunning && TraceTick()) return;
+
+#endif  /* GOLDEN_TRACE */
+#ifdef MAP_CHANGE_LOG
+        StartMapChangeLog();
+
+#endif  /* MAP_CHANGE_LOG */
+        AnimatePalette();
+
+        {  /* for scope */
+            word result = ProcessGameInputHelper(activePage, demo_state);
+            if (result == GAME_INPUT_QUIT) return;
+            if (result == GAME_INPUT_RESTART) continue;
+        }
+
+        MovePlayer();
+
+        if (scooterMounted != 0) {
+            MovePlayerScooter();
+        }
+
+        if (queuePlayerDizzy || playerDizzyLeft != 0) {
+            ProcessPlayerDizzy();
+        }
+
+        MovePlatforms();
+        MoveFountains();
+        DrawMapRegion();
+
+        if (ProcessAndDrawPlayer()) continue;
+
+        DrawFountains();
+        MoveAndDrawActors();
+        MoveAndDrawShards();
+        MoveAndDrawSpawners();
+        DrawRandomEffects();
+        DrawExplosions();
+        MoveAndDrawDecorations();
+        DrawLights();
+
+        if (demoState != DEMO_STATE_NONE) {
+            DrawSprite(SPR_DEMO_OVERLAY, 0, 18, 4, DRAW_MODE_ABSOLUTE);
+        }
+
+#ifdef DEBUG_BAR
+#define BSTR(value) ((value) ? "T" : "F")
+        {
+            char debugBar[41];
+            word x, y, southmove;
+            static word spinoff = 0;
+            bool ise, isw;
+
+            for (x = 0; x < 40; x++) {
+                DrawSpriteTile(fontTileData + FONT_BACKGROUND_GRAY, x, 0);
+                for (y = 19; y < 25; y++) {
+                    DrawSpriteTile(fontTileData + FONT_BACKGROUND_GRAY, x, y);
+                }
+            }
+
+            /* Dump variable contents into bars at the top/bottom of the screen */
+
+            sprintf(debugBar,
+                "E%uL%02u PX=%04u PY=%04u SX=%04u SY=%04u",
+                EPISODE, levelNum, playerX, playerY, scrollX, scrollY
+            );
+            DrawTextLine(0, 0, debugBar);
+            sprintf(debugBar,
+                "Score=%07lu Health=%d:%u Bomb=%u Star=%02lu",
+                gameScore, playerHealth - 1, playerHealthCells, playerBombs, gameStars
+            );
+            DrawTextLine(0, 19, debugBar);
+            sprintf(debugBar,
+                "CJ=%s CJL=%s iR=%s iLJ=%s JT=%u RL=%02u PS=%u",
+                BSTR(cmdJump), BSTR(cmdJumpLatch), BSTR(isPlayerRecoiling), BSTR(isPlayerLongJumping),
+                playerJumpTime, playerRecoilLeft, pounceStreak
+            );
+            DrawTextLine(0, 21, debugBar);
+            sprintf(debugBar,
+                "iF=%s FT=%02d QD=%s DL=%u HC=%02u DT=%02u FDT=%02u",
+                BSTR(isPlayerFalling), playerFallTime, BSTR(queuePlayerDizzy),
+                playerDizzyLeft, playerHurtCooldown, playerDeadTime, playerFallDeadTime
+            );
+            DrawTextLine(0, 22, debugBar);
+            southmove = TestPlayerMove(DIR4_SOUTH, playerX, playerY + 1);
+            ise = isPlayerSlidingEast;
+            isw = isPlayerSlidingWest;
+            sprintf(debugBar,
+                "NSWE=%u%u%u%u iSE=%s iSW=%s bAbM=%s%s cC=%s CD=%u",
+                TestPlayerMove(DIR4_NORTH, playerX, playerY - 1),
+                southmove,
+                TestPlayerMove(DIR4_WEST, playerX - 1, playerY),
+                TestPlayerMove(DIR4_EAST, playerX + 1, playerY),
+                BSTR(ise), BSTR(isw), BSTR(blockActionCmds), BSTR(blockMovementCmds),
+                BSTR(canPlayerCling), playerClingDir
+            );
+            DrawTextLine(0, 23, debugBar);
+
+            spinoff += 8;
+            if (spinoff >= 4 * 8) spinoff = 0;
+            EGA_MODE_LATCHED_WRITE();
+            DrawSolidTile(TILE_WAIT_SPINNER_1 + spinoff, 39 + (0 * 320));
+        }
+#undef BSTR
+#endif  /* DEBUG_BAR */
+
+#ifdef LAZY_STATUS_BAR
+        FlushStatusBar();
+#endif  /* LAZY_STATUS_BAR */
+        SelectDrawPage(activePage);
+        activePage = !activePage;
+        SelectActivePage(activePage);
+#ifdef RETRACE_FLIP
+        WaitForRetrace();
+#endif  /* RETRACE_FLIP */
+#ifdef INPUT_EVENTS
+        RecordInputLatency();
+#endif  /* INPUT_EVENTS */
+
+        if (pounceHintState == POUNCE_HINT_QUEUED) {
+            pounceHintState = POUNCE_HINT_SEEN;
+            ShowPounceHint();
+        }
+
+#ifdef BENCHMARK
+        /* A workload covers one map; the next one doesn't count toward it */
+        if (isBenchmarkRunning && (winLevel || winGame)) return;
+
+#endif  /* BENCHMARK */
+        if (winLevel) {
+            winLevel = false;
+            StartSound(SND_WIN_LEVEL);
+            NextLevel();
+            InitializeLevel(levelNum);
+        } else if (winGame) {
+            break;
+        }
+    }
+
+    ShowEnding();
+}
+
+/*
+Insert either a regular actor or a special actor into the world. The map format
+reserves types 0..31 for special actors, and map types 31+ become regular actors
+starting from type 0. (Map actor type 31 has overlapping branch coverage, but as
+a special actor it is a no-op due to no matching switch case.)
+
+The caller must provide the index for regular actors, which is convoluted.
+*/
+static void NewMapActorAtIndex(
+    word index, word map_actor_type, word x_origin, word y_origin
+) {
+    if (map_actor_type < 32) {
+        switch (map_actor_type) {
+        case SPA_PLAYER_START:
+            if (x_origin > mapWidth - 15) {
+                scrollX = mapWidth - SCROLLW;
+            } else if ((int)x_origin - 15 >= 0 && mapYPower > 5) {
+                scrollX = x_origin - 15;
+            } else {
+                scrollX = 0;
+            }
+
+            if ((int)y_origin - 10 >= 0) {
+                scrollY = y_origin - 10;
+            } else {
+                scrollY = 0;
+            }
+
+            playerX = x_origin;
+            playerY = y_origin;
+
+            break;
+
+        case SPA_PLATFORM:
+            platforms[numPlatforms].x = x_origin;
+            platforms[numPlatforms].y = y_origin;
+            numPlatforms++;
+
+            break;
+
+        case SPA_FOUNTAIN_SMALL:
+        case SPA_FOUNTAIN_MEDIUM:
+        case SPA_FOUNTAIN_LARGE:
+        case SPA_FOUNTAIN_HUGE:
+            fountains[numFountains].x = x_origin - 1;
+            fountains[numFountains].y = y_origin - 1;
+            fountains[numFountains].dir = DIR4_NORTH;
+            fountains[numFountains].stepcount = 0;
+            fountains[numFountains].height = 0;
+            fountains[numFountains].stepmax = map_actor_type * 3;
+            fountains[numFountains].delayleft = 0;
+            numFountains++;
+
+            break;
+
+        case SPA_LIGHT_WEST:
+        case SPA_LIGHT_MIDDLE:
+        case SPA_LIGHT_EAST:
+            if (numLights == MAX_LIGHTS - 1) break;
+
+            /* Normalize SPA_LIGHT_* into LIGHT_SIDE_* */
+            lights[numLights].side = map_actor_type - SPA_LIGHT_WEST;
+            lights[numLights].x = x_origin;
+            lights[numLights].y = y_origin;
+            numLights++;
+
+            break;
+        }
+    }
+
+    if (map_actor_type < 31) return;
+
+    if (NewActorAtIndex(index, map_actor_type - 31, x_origin, y_origin)) {
+        numActors++;
+    }
+}
+
+#ifdef MAP_PAGING
+/*
+Read the map cells that follow the actors in a map's group entry, which holds
+`cell_bytes` bytes of them. Maps that fit in the map memory get read straight in
+like the original game did. Taller maps get copied into the swap file, then the
+pages at the top of the map are read back in. The map memory is split between
+the window of pages around the game window and the slots for pages in use away
+from it (see `mapSlots`).
+*/
+static void LoadMapCells(FILE *fp, dword cell_bytes)
+{
+    word chunk, i;
+    word rowbytes = mapWidth * 2;
+    word pagewords = MAP_PAGING << mapYPower;
+    word numpages = ((WORD_MAX / 2) >> mapYPower) / MAP_PAGING;
+    word windowpages;
+
+    mapRows = (word)(0x10000L / rowbytes);
+    mapWindowRows = mapRows;
+    mapWindowY = 0;
+    mapWindowBase = mapData.w;
+    numMapSlots = 0;
+    isMapPaged = false;
+
+    /* A copy of the page above, and enough pages to always hold the game window */
+    if (cell_bytes > WORD_MAX && numpages >= 4 && mapSwapFp == NULL) {
+        mapSwapFp = fopen(JoinPath(writePath, FILENAME_BASE ".SWP"), "w+b");
+    }
+
+    if (cell_bytes <= WORD_MAX || numpages < 4 || mapSwapFp == NULL) {
+        fread(mapData.b, WORD_MAX, 1, fp);
+
+        return;
+    }
+
+    if (cell_bytes / rowbytes > (WORD_MAX / MAP_PAGING) * MAP_PAGING) {
+        cell_bytes = (dword)((WORD_MAX / MAP_PAGING) * MAP_PAGING) * rowbytes;
+    }
+
+    /* About half of the pages go to the window, the rest to slots */
+    windowpages = (numpages - 1) / 2;
+    if (windowpages < 3) windowpages = 3;
+    numMapSlots = (numpages - 1 - windowpages) / 2;
+    if (numMapSlots > MAX_MAP_SLOTS) numMapSlots = MAX_MAP_SLOTS;
+
+    mapRows = (word)(cell_bytes / rowbytes);
+    mapWindowRows = windowpages * MAP_PAGING;
+    mapWindowBase = mapData.w + pagewords;
+    isMapPaged = true;
+    memset(mapPageDirty, false, sizeof mapPageDirty);
+
+    for (i = 0; i < numMapSlots; i++) {
+        mapSlots[i].page = WORD_MAX;
+        mapSlots[i].lastused = 0;
+        mapSlots[i].base = mapWindowBase + ((windowpages + (i * 2) + 1) * pagewords);
+    }
+
+    mapSlotClock = 0;
+
+    rewind(mapSwapFp);
+    for (cell_bytes = (dword)mapRows * rowbytes; cell_bytes > 0; cell_bytes -= chunk) {
+        chunk = cell_bytes > mapWindowRows * rowbytes ?
+            mapWindowRows * rowbytes : (word)cell_bytes;
+        fread(mapData.b, chunk, 1, fp);
+        fwrite(mapData.b, chunk, 1, mapSwapFp);
+    }
+
+    rewind(mapSwapFp);
+    fread(mapWindowBase, mapWindowRows * rowbytes, 1, mapSwapFp);
+}
+#endif  /* MAP_PAGING */
+
+/*
+Load data from a map file, initialize global state, and build all actors.
+
+This makes a waaay unsafe assumption about the Platform struct packing.
+
+#ifdef MAP_PAGING: Maps too tall for the map memory are paged; see LoadMapCells().
+*/
+static void LoadMapData(word level_num)
+{
+    word i;
+    word actorwords;
+    word t;  /* holds a map actor's *T*ype OR a *T*ile's horizontal position */
+    FILE *fp = GroupEntryFp(mapNames[level_num]);
+#ifdef MAP_PAGING
+    dword entrylength = lastGroupEntryLength;
+#endif  /* MAP_PAGING */
+
+#ifdef CARTOON_CACHE
+    if (cartoonData == NULL)
+#endif  /* CARTOON_CACHE */
+    isCartoonDataLoaded = false;
+
+#ifdef SPRITE_CLIP
+    isInFrontMaskValid = false;
+#endif  /* SPRITE_CLIP */
+
+    getw(fp);  /* skip over map flags */
     mapWidth = getw(fp);
 
-    switch (mapWidth) {
-    case 1 << 5:
-        mapYPower = 5;
-        break;
-    case 1 << 6:
-        mapYPower = 6;
-        break;
-    case 1 << 7:
-        mapYPower = 7;
-        break;
-    case 1 << 8:
-        mapYPower = 8;
-        break;
-    case 1 << 9:
-        mapYPower = 9;
-        break;
-    case 1 << 10:
-        mapYPower = 10;
-        break;
-    case 1 << 11:
-        mapYPower = 11;
-        break;
+    switch (mapWidth) {
+    case 1 << 5:
+        mapYPower = 5;
+        break;
+    case 1 << 6:
+        mapYPower = 6;
+        break;
+    case 1 << 7:
+        mapYPower = 7;
+        break;
+    case 1 << 8:
+        mapYPower = 8;
+        break;
+    case 1 << 9:
+        mapYPower = 9;
+        break;
+    case 1 << 10:
+        mapYPower = 10;
+        break;
+    case 1 << 11:
+        mapYPower = 11;
+        break;
+    }
+
+    actorwords = getw(fp);  /* total size of actor data, in words */
+    numActors = 0;
+    numPlatforms = 0;
+    numFountains = 0;
+    numLights = 0;
+    areLightsActive = true;
+    hasLightSwitch = false;
+
+    fread(mapData.w, actorwords, 2, fp);
+
+    for (i = 0; i < actorwords; i += 3) {  /* each actor is 3 words long */
+        register word x, y;
+
+        t = *(mapData.w + i);
+        x = *(mapData.w + i + 1);
+        y = *(mapData.w + i + 2);
+        NewMapActorAtIndex(numActors, t, x, y);
+
+        if (numActors > MAX_ACTORS - 1) break;
+    }
+
+#ifdef MAP_PAGING
+    LoadMapCells(fp, entrylength - 6 - ((dword)actorwords * 2));
+#else
+    fread(mapData.b, WORD_MAX, 1, fp);
+#endif  /* MAP_PAGING */
+    fclose(fp);
+
+    for (i = 0; i < numPlatforms; i++) {
+        for (t = 2; t < 7; t++) {
+            /* This is an ugly method of accessing Platform.mapstash */
+            *((word *)(platforms + i) + t) = MAP_CELL_DATA_SHIFTED(
+                platforms[i].x, platforms[i].y, t - 4
+            );
+        }
+    }
+
+    levelNum = level_num;
+#ifdef MAP_PAGING
+    maxScrollY = mapRows - (SCROLLH + 1);
+#else
+    maxScrollY = (word)(0x10000L / (mapWidth * 2)) - (SCROLLH + 1);
+#endif  /* MAP_PAGING */
+
+#ifdef DEMO_DESYNC_CHECK
+    /* From here on, SetMapTile() keeps this up to date. */
+    mapHash = 0;
+    for (i = 0; i <= WORD_MAX / 2; i++) {
+        mapHash += MAP_CELL_HASH(i, *(mapData.w + i));
+    }
+#ifdef MAP_CHANGE_LOG
+    /* ...by way of the map change log, which has nothing for this map yet. */
+    ForgetMapChanges();
+#endif  /* MAP_CHANGE_LOG */
+#endif  /* DEMO_DESYNC_CHECK */
+}
+
+/*
+Track the backdrop parameters (backdrop number and horizontal/vertical scroll
+flags) and return true if they have changed since the last call. Otherwise
+return false.
+*/
+static bbool IsNewBackdrop(word backdrop_num)
+{
+    static word lastnum = WORD_MAX;
+    static word lasth = WORD_MAX;
+    static word lastv = WORD_MAX;
+
+    if (backdrop_num != lastnum || hasHScrollBackdrop != lasth || hasVScrollBackdrop != lastv) {
+        lastnum = backdrop_num;
+        lasth = hasHScrollBackdrop;
+        lastv = hasVScrollBackdrop;
+
+        return true;
+    }
+
+    return false;
+}
+
+/*
+Load the specified backdrop image data into the video memory. Requires a scratch
+buffer twice the size of BACKDROP_SIZE *plus* 640 bytes to perform this work.
+
+Depending on the current backdrop scroll settings, up to four versions of the
+backdrop are copied into EGA video memory. This is due to how the parallax
+scrolling works, which is explained in detail in DrawMapRegion().
+*/
+static void LoadBackdropData(char *entry_name, byte *scratch)
+{
+    FILE *fp = GroupEntryFp(entry_name);
+
+    EGA_MODE_DEFAULT();
+    EGA_BIT_MASK_DEFAULT();
+
+    miscDataContents = IMAGE_NONE;
+    fread(scratch, BACKDROP_SIZE, 1, fp);
+
+    /*
+    Copy the unmodified backdrop. This is all we need if there is no backdrop
+    scrolling.
+    */
+    CopyTilesToEGA(scratch, BACKDROP_SIZE_EGA_MEM, EGA_OFFSET_BDROP_EVEN);
+
+    if (hasHScrollBackdrop) {
+        /*
+        To do horizontal backdrop scrolling, we need a copy of the backdrop
+        shifted left by 4 pixels.
+        */
+        WrapBackdropHorizontal(scratch, scratch + BACKDROP_SIZE);
+        CopyTilesToEGA(scratch + BACKDROP_SIZE, BACKDROP_SIZE_EGA_MEM, EGA_OFFSET_BDROP_ODD_X);
+    }
+
+    if (hasVScrollBackdrop) {
+        /*
+        To do vertical backdrop scrolling, we need a copy of the backdrop
+        shifted up by 4 pixels.
+        */
+        WrapBackdropVertical(scratch, miscData + 5000, scratch + (2 * BACKDROP_SIZE));
+        CopyTilesToEGA(miscData + 5000, BACKDROP_SIZE_EGA_MEM, EGA_OFFSET_BDROP_ODD_Y);
+
+        /*
+        If horizontal scrolling is also enabled, we additionally need one that's
+        shifted both left and up by 4. Here, the assumption is that scratch +
+        BACKDROP_SIZE holds a copy of the backdrop that's already shifted to the
+        left, which will be the case if hasHScrollBackdrop is also true, but not
+        otherwise. This is also why the code just above uses miscData + 5000 to
+        store the shifted copy of the backdrop, instead of using scratch +
+        BACKDROP_SIZE as the horizontal version of this code does.
+
+        If horizontal scrolling is not enabled, the game still does this, but it
+        will end up operating on random garbage data. However, that doesn't
+        really cause any issues because EGA_OFFSET_BDROP_ODD_XY is never used if
+        horizontal scrolling is not enabled.
+        */
+        WrapBackdropVertical(scratch + BACKDROP_SIZE, miscData + 5000, scratch + (2 * BACKDROP_SIZE));
+        CopyTilesToEGA(miscData + 5000, BACKDROP_SIZE_EGA_MEM, EGA_OFFSET_BDROP_ODD_XY);
+    }
+
+    fclose(fp);
+}
+
+/*
+Reset all of the global variables to prepare for (re)entry into a map. These are
+a mix of player movement variables, actor interactivity flags, and map state.
+*/
+static void InitializeMapGlobals(void)
+{
+    winGame = false;
+    playerClingDir = DIR4_NONE;
+    isPlayerFalling = true;
+    cmdJumpLatch = true;
+    playerJumpTime = 0;
+    playerFallTime = 1;
+    isPlayerRecoiling = false;
+    playerRecoilLeft = 0;
+    playerFaceDir = DIR4_EAST;
+    playerFrame = PLAYER_WALK_1;
+    playerBaseFrame = PLAYER_BASE_EAST;
+    playerDeadTime = 0;
+    winLevel = false;
+    playerHurtCooldown = 40;
+    transporterTimeLeft = 0;
+    activeTransporter = 0;
+    isPlayerInPipe = false;
+    scooterMounted = 0;
+    isPlayerNearTransporter = false;
+    isPlayerNearHintGlobe = false;
+    areForceFieldsActive = true;
+    blockMovementCmds = false;
+
+    ClearPlayerDizzy();
+
+    blockActionCmds = false;
+    arePlatformsActive = true;
+    isPlayerInvincible = false;
+    paletteStepCount = 0;
+    randStepCount = 0;
+    playerFallDeadTime = 0;
+    sawHurtBubble = false;
+    sawAutoHintGlobe = false;
+    numBarrels = 0;
+    numEyePlants = 0;
+    pounceStreak = 0;
+
+    sawJumpPadBubble =
+        sawMonumentBubble =
+        sawScooterBubble =
+        sawTransporterBubble =
+        sawPipeBubble =
+        sawBossBubble =
+        sawPusherRobotBubble =
+        sawBearTrapBubble =
+        sawMysteryWallBubble =
+        sawTulipLauncherBubble =
+        sawHamburgerBubble = false;
+}
+
+#ifdef LEVEL_RESTART
+#define LEVEL_IMAGE_VAR(var) {&(var), sizeof (var)}
+
+/*
+Everything that LoadMapData() sets up apart from the map cells (which are
+journaled) and the actors (whose count varies). numActors must be in here.
+*/
+static struct {
+    void *data;
+    word size;
+} levelImageRegions[] = {
+    LEVEL_IMAGE_VAR(playerX), LEVEL_IMAGE_VAR(playerY),
+    LEVEL_IMAGE_VAR(scrollX), LEVEL_IMAGE_VAR(scrollY),
+    LEVEL_IMAGE_VAR(platforms), LEVEL_IMAGE_VAR(numPlatforms),
+    LEVEL_IMAGE_VAR(fountains), LEVEL_IMAGE_VAR(numFountains),
+    LEVEL_IMAGE_VAR(lights), LEVEL_IMAGE_VAR(numLights),
+    LEVEL_IMAGE_VAR(hasLightSwitch), LEVEL_IMAGE_VAR(areLightsActive),
+    LEVEL_IMAGE_VAR(arePlatformsActive), LEVEL_IMAGE_VAR(mysteryWallTime),
+    LEVEL_IMAGE_VAR(numBarrels), LEVEL_IMAGE_VAR(numEyePlants),
+    LEVEL_IMAGE_VAR(nextActorIndex), LEVEL_IMAGE_VAR(randStepCount),
+#ifdef DEMO_DESYNC_CHECK
+    LEVEL_IMAGE_VAR(mapHash),
+#endif  /* DEMO_DESYNC_CHECK */
+    LEVEL_IMAGE_VAR(numActors)
+};
+#define NUM_LEVEL_IMAGE_REGIONS (sizeof levelImageRegions / sizeof levelImageRegions[0])
+
+/*
+Return the number of bytes needed to hold a level image.
+*/
+static word LevelImageSize(void)
+{
+    word size = MAX_ACTORS * sizeof(Actor);
+    word i;
+
+    for (i = 0; i < NUM_LEVEL_IMAGE_REGIONS; i++) {
+        size += levelImageRegions[i].size;
+    }
+
+    return size;
+}
+
+/*
+Copy the freshly loaded level into the level image, along with the episode
+values that were just saved to the temporary save file, and start the map
+journal over. The image and journal get their own allocations the first time
+through; if either can't be had, levels restart the original way.
+
+#ifdef MEMORY_ARENAS: The image comes out of the level arena instead, anew for
+every level.
+*/
+static void SaveLevelImage(void)
+{
+    byte *dest;
+    word i;
+    bool journaled;
+
+#if defined(DEMO_DESYNC_CHECK) && defined(MAP_CHANGE_LOG)
+    HashMapChanges();
+#endif  /* DEMO_DESYNC_CHECK && MAP_CHANGE_LOG */
+    journaled = AllocateMapJournal();
+
+#ifdef MEMORY_ARENAS
+    /* The last level's image went away when the level arena was emptied */
+    levelImage = ArenaAlloc(&levelArena, LevelImageSize());
+#else
+    if (levelImage == NULL) {
+        levelImage = malloc(LevelImageSize());
+    }
+#endif  /* MEMORY_ARENAS */
+
+    isLevelImageValid = false;
+    if (!journaled || levelImage == NULL) return;
+
+    dest = levelImage;
+
+    for (i = 0; i < NUM_LEVEL_IMAGE_REGIONS; i++) {
+        movmem(levelImageRegions[i].data, dest, levelImageRegions[i].size);
+        dest += levelImageRegions[i].size;
+    }
+
+    movmem(actors, dest, numActors * sizeof(Actor));
+
+    levelStart.health = playerHealth;
+    levelStart.cells = playerHealthCells;
+    levelStart.bombs = playerBombs;
+    levelStart.score = gameScore;
+    levelStart.stars = gameStars;
+    levelStart.usedcheat = usedCheatCode;
+
+    ResetMapJournal();
+    isLevelImageValid = true;
+}
+
+/*
+Stand-in for LoadMapData() when a level restarts: put the map and everything
+loading it set up back the way they were, without reading anything.
+*/
+static void RestoreLevelImage(void)
+{
+    byte *src = levelImage;
+    word i;
+
+    for (i = 0; i < NUM_LEVEL_IMAGE_REGIONS; i++) {
+        movmem(src, levelImageRegions[i].data, levelImageRegions[i].size);
+        src += levelImageRegions[i].size;
+    }
+
+    movmem(src, actors, numActors * sizeof(Actor));
+
+    RollBackMap(0);
+
+#ifdef SPRITE_CLIP
+    isInFrontMaskValid = false;
+#endif  /* SPRITE_CLIP */
+}
+#endif  /* LEVEL_RESTART */
+
+/*
+Switch to a new level (or reload the current one) and perform all related
+initialization tasks.
+
+#ifdef LEVEL_RESTART: When restarting, the level comes from the level image, and
+the map header and temporary save file are left alone.
+*/
+void InitializeLevel(word level_num)
+{
+    static word mapVariables, musicNum;
+    FILE *fp;
+    word bdnum;
+
+    if (level_num == 0 && isNewGame) {
+        DrawFullscreenImage(IMAGE_ONE_MOMENT);
+        /* All my childhood, I wondered what it was doing here. It's bupkis. */
+        WaitSoft(300);
+    } else {
+        FadeOut();
+    }
+
+#ifdef LEVEL_RESTART
+    /* The header is the same as it was when the level was loaded */
+    if (!isLevelRestarting) {
+        fp = GroupEntryFp(mapNames[level_num]);
+        mapVariables = getw(fp);
+        fclose(fp);
+    }
+#else
+    fp = GroupEntryFp(mapNames[level_num]);
+    mapVariables = getw(fp);
+    fclose(fp);
+#endif  /* LEVEL_RESTART */
+
+#ifdef MEMORY_ARENAS
+#ifdef LEVEL_RESTART
+    /* A restarting level still needs what it allocated the first time */
+    if (!isLevelRestarting)
+#endif  /* LEVEL_RESTART */
+    ResetArena(&levelArena);
+#endif  /* MEMORY_ARENAS */
+
+    StopMusic();
+
+    hasRain = (bool)(mapVariables & 0x0020);
+    bdnum = mapVariables & 0x001f;
+    hasHScrollBackdrop = (bool)(mapVariables & 0x0040);
+    hasVScrollBackdrop = (bool)(mapVariables & 0x0080);
+    paletteAnimationNum = (byte)(mapVariables >> 8) & 0x07;
+    musicNum = (mapVariables >> 11) & 0x001f;
+
+    InitializeMapGlobals();
+
+    if (IsNewBackdrop(bdnum)) {
+        LoadBackdropData(backdropNames[bdnum], mapData.b);
+    }
+
+#ifdef LEVEL_RESTART
+    if (isLevelRestarting) {
+        RestoreLevelImage();
+    } else {
+        LoadMapData(level_num);
+    }
+#else
+    LoadMapData(level_num);
+#endif  /* LEVEL_RESTART */
+
+    if (level_num == 0 && isNewGame) {
+        FadeOut();
+        isNewGame = false;
+    }
+
+    if (demoState == DEMO_STATE_NONE) {
+        switch (level_num) {
+        case 0:
+        case 1:
+        case 4:
+        case 5:
+        case 8:
+        case 9:
+        case 12:
+        case 13:
+        case 16:
+        case 17:
+            SelectDrawPage(0);
+            SelectActivePage(0);
+            ClearScreen();
+            FadeIn();
+            ShowLevelIntro(level_num);
+            WaitSoft(150);
+            FadeOut();
+            break;
+        }
+    }
+
+    InitializeShards();
+    InitializeExplosions();
+    InitializeDecorations();
+    ClearPlayerPush();
+    InitializeSpawners();
+
+    ClearGameScreen();
+    SelectDrawPage(activePage);
+    activePage = !activePage;
+    SelectActivePage(activePage);
+
+#ifdef LEVEL_RESTART
+    if (!isLevelRestarting) {
+        SaveGameState('T');
+        SaveLevelImage();
+    }
+#else
+    SaveGameState('T');
+#endif  /* LEVEL_RESTART */
+    StartGameMusic(musicNum);
+
+#ifdef LEVEL_RESTART
+    /* Only a full-screen image or a backdrop would have replaced these */
+    if (!isAdLibPresent && !(isLevelRestarting && miscDataContents == IMAGE_TILEATTR)) {
+#else
+    if (!isAdLibPresent) {
+#endif  /* LEVEL_RESTART */
+        tileAttributeData = miscData + 5000;
+        miscDataContents = IMAGE_TILEATTR;
+        LoadTileAttributeData("TILEATTR.MNI");
+    }
+
+    FadeIn();
+
+#ifdef EXPLOSION_PALETTE
+    if (paletteAnimationNum == PAL_ANIM_EXPLOSIONS) {
+        SetPaletteRegister(PALETTE_KEY_INDEX, MODE1_BLACK);
+    }
+#endif  /* EXPLOSION_PALETTE */
+}
+
+/*
+Set all variables that pertain to the state of the overarching game. These are
+set once at the beginning of each episode and retain their values across levels.
+*/
+void InitializeEpisode(void)
+{
+    gameScore = 0;
+    playerHealth = 4;
+    playerHealthCells = 3;
+    levelNum = 0;
+    playerBombs = 0;
+    gameStars = 0;
+    demoDataPos = 0;
+    demoDataLength = 0;
+    usedCheatCode = false;
+    sawBombHint = false;
+    sawHealthHint = false;
+}
+
+#ifdef BENCHMARK
+/*
+Comparison function for sorting tick durations with qsort().
+*/
+static int CompareBenchmarkFrames(const void *a, const void *b)
+{
+    dword x = *(dword *)a, y = *(dword *)b;
+
+    if (x < y) return -1;
+    if (x > y) return 1;
+
+    return 0;
+}
+
+/*
+Convert a duration in ReadPreciseClock() units into microseconds. Each unit is
+0.838096 microseconds, which 88/105 matches to six places.
+*/
+#define PRECISE_TO_US(t) (((t) * 88) / 105)
+
+/*
+Append the results of the most recent benchmark run to BENCH.JSN. Tick rates are
+printed with two decimal places and tick durations in microseconds, all computed
+in integer math.
+*/
+static void WriteBenchmarkResult(char *name, char *entry_name, byte mode, word actors)
+{
+    static char *modeNames[] = {"sim", "render", "both"};
+    static word numResults = 0;
+    dword elapsed = 0;
+    dword rate = 0;
+    dword p50 = 0, p99 = 0;
+    word i;
+
+    for (i = 0; i < numBenchmarkFrames; i++) {
+        elapsed += PRECISE_TO_US(benchmarkFrames[i]);
+    }
+
+    if (elapsed != 0) {
+        /* Whole ticks per second first, then the hundredths from what's left */
+        dword scaled = (dword)numBenchmarkFrames * 1000000L;
+
+        rate = ((scaled / elapsed) * 100) + ((scaled % elapsed) / ((elapsed + 99) / 100));
+    }
+
+    if (numBenchmarkFrames != 0) {
+        qsort(benchmarkFrames, numBenchmarkFrames, sizeof(dword), CompareBenchmarkFrames);
+
+        p50 = PRECISE_TO_US(benchmarkFrames[numBenchmarkFrames / 2]);
+        p99 = PRECISE_TO_US(benchmarkFrames[(word)(((dword)numBenchmarkFrames * 99) / 100)]);
+    }
+
+    fprintf(benchmarkFp,
+        "%s\n    {\"name\": \"%s\", \"entry\": \"%s\", \"mode\": \"%s\", "
+        "\"ticks\": %u, \"actors\": %u, \"ticks_per_sec\": %lu.%02lu, "
+        "\"p50_us\": %lu, \"p99_us\": %lu}",
+        numResults == 0 ? "" : ",", name, entry_name, modeNames[mode],
+        numBenchmarkFrames, actors, rate / 100, rate % 100, p50, p99
+    );
+
+    numResults++;
+}
+
+/*
+Draw the game window and flip pages without moving anything. This is the render
+half of the game loop, minus the effects that only exist while things move.
+*/
+static void DrawBenchmarkFrame(void)
+{
+    word i;
+
+    DrawMapRegion();
+
+    for (i = 0; i < numActors; i++) {
+        Actor *act = actors + i;
+
+        if (!act->dead && IsSpriteVisible(act->sprite, act->frame, act->x, act->y)) {
+            DrawSprite(act->sprite, act->frame, act->x, act->y, DRAW_MODE_NORMAL);
+        }
+    }
+
+    DrawPlayer(playerBaseFrame + playerFrame, playerX, playerY, DRAW_MODE_NORMAL);
+    DrawLights();
+
+    SelectDrawPage(activePage);
+    activePage = !activePage;
+    SelectActivePage(activePage);
+}
+
+/*
+Start a fresh game on `level_num` and run one benchmark workload on it in the
+given BENCHMARK_* mode. Everything that influences the outcome is reset first,
+so that every run of the same workload does the same things. Returns the number
+of actors the level had when it was loaded, which is also what gets reported.
+*/
+static word RunBenchmarkWorkload(char *name, word level_num, byte mode)
+{
+    word loadactors;
+
+    InitializeEpisode();
+    levelNum = level_num;
+    SeedRandomState(1);
+    memset(&tickStatics, 0, sizeof tickStatics);
+    benchmarkScriptPos = benchmarkScriptLeft = 0;
+
+    InitializeLevel(level_num);
+    LoadMaskedTileData("MASKTILE.MNI");
+
+    /* Actors spawned during the run would count otherwise */
+    loadactors = numActors;
+
+    numBenchmarkFrames = 0;
+    isBenchmarkTiming = false;
+    isRenderSuppressed = (mode == BENCHMARK_SIM);
+
+    if (mode == BENCHMARK_RENDER) {
+        while (!BenchmarkFrame()) {
+            DrawBenchmarkFrame();
+        }
+    } else {
+        isInGame = true;
+        GameLoop(DEMO_STATE_PLAY);
+        isInGame = false;
+
+        /* GameLoop() returned early instead of moving on to another map */
+        winLevel = winGame = false;
+    }
+
+    isRenderSuppressed = false;
+    StopMusic();
+
+    WriteBenchmarkResult(name, mapNames[level_num], mode, loadactors);
+
+    return loadactors;
+}
+
+/*
+Run every benchmark workload and write the results to BENCH.JSN: each distinct
+map in the episode, then the map that had the most actors and a map with both
+rain and lights again under names of their own, then the title screens.
+*/
+static void RunBenchmarkSuite(void)
+{
+    word i, j;
+    byte mode;
+    word actors, densest = 0, mostactors = 0;
+    word rainlights = WORD_MAX;
+
+    benchmarkFp = fopen("BENCH.JSN", "w");
+    if (benchmarkFp == NULL) return;
+
+    fprintf(benchmarkFp,
+        "{\n  \"episode\": %d,\n  \"version\": \"%s\",\n  \"clock_hz\": %u,\n"
+        "  \"ticks\": %u,\n  \"workloads\": [",
+        EPISODE, GAME_VERSION, interruptClockRate, BENCHMARK
+    );
+
+    isBenchmarkRunning = true;
+    isClockUnthrottled = true;
+    isGodMode = true;
+    demoState = DEMO_STATE_PLAY;
+
+    for (i = 0; i < sizeof(mapNames) / sizeof(mapNames[0]); i++) {
+        /* Bonus maps appear more than once; only measure them the first time */
+        for (j = 0; j < i; j++) {
+            if (strcmp(mapNames[i], mapNames[j]) == 0) break;
+        }
+        if (j < i) continue;
+
+        for (mode = BENCHMARK_SIM; mode <= BENCHMARK_BOTH; mode++) {
+            actors = RunBenchmarkWorkload("level", i, mode);
+        }
+
+        if (actors > mostactors) {
+            mostactors = actors;
+            densest = i;
+        }
+
+        if (rainlights == WORD_MAX && hasRain && numLights != 0) {
+            rainlights = i;
+        }
+    }
+
+    for (mode = BENCHMARK_SIM; mode <= BENCHMARK_BOTH; mode++) {
+        RunBenchmarkWorkload("densest_actors", densest, mode);
+    }
+
+    if (rainlights != WORD_MAX) {
+        for (mode = BENCHMARK_SIM; mode <= BENCHMARK_BOTH; mode++) {
+            RunBenchmarkWorkload("rain_and_lights", rainlights, mode);
+        }
+    }
+
+    /* The attract loop, but without waiting around between screens */
+    StartMenuMusic(MUSIC_ZZTOP);
+    numBenchmarkFrames = 0;
+    isBenchmarkTiming = false;
+    while (!BenchmarkFrame()) {
+        DrawFullscreenImage(numBenchmarkFrames % 2 == 0 ? IMAGE_TITLE : IMAGE_CREDITS);
+    }
+    StopMusic();
+
+    WriteBenchmarkResult("title", fullscreenImageNames[IMAGE_TITLE], BENCHMARK_BOTH, 0);
+
+    isBenchmarkRunning = false;
+    isClockUnthrottled = false;
+    isGodMode = false;
+    demoState = DEMO_STATE_NONE;
+
+    fprintf(benchmarkFp, "\n  ]\n}\n");
+    fclose(benchmarkFp);
+}
+#endif  /* BENCHMARK */
+
+#ifdef HAS_TICK_STEPPER
+/*
+Run one game tick with `cmd` as the input, without drawing. This makes the same
+calls in the same order as GameLoop() does, and the commands are held back the
+same way ProcessGameInput() holds back a player's while movement or actions are
+blocked, so that whatever is played through here plays back the same way from a
+demo. If a demo is being recorded, the tick goes into it.
+*/
+static void StepGameTick(byte cmd)
+{
+#ifdef MAP_CHANGE_LOG
+    StartMapChangeLog();
+
+#endif  /* MAP_CHANGE_LOG */
+    AnimatePalette();
+
+    if (blockMovementCmds) cmd &= ~(0x01 | 0x02 | 0x10);
+    if (blockActionCmds) cmd &= ~(0x04 | 0x08 | 0x20);
+
+    cmdWest  = (bbool)(cmd & 0x01);
+    cmdEast  = (bbool)(cmd & 0x02);
+    cmdNorth = (bbool)(cmd & 0x04);
+    cmdSouth = (bbool)(cmd & 0x08);
+    cmdJump  = (bbool)(cmd & 0x10);
+    cmdBomb  = (bbool)(cmd & 0x20);
+    winLevel = false;
+
+#ifdef DEMO_STREAM
+    if (demoStream != NULL) WriteDemoFrame();
+#endif  /* DEMO_STREAM */
+
+    MovePlayer();
+
+    if (scooterMounted != 0) {
+        MovePlayerScooter();
+    }
+
+    if (queuePlayerDizzy || playerDizzyLeft != 0) {
+        ProcessPlayerDizzy();
+    }
+
+    MovePlatforms();
+    MoveFountains();
+    DrawMapRegion();
+
+    /* The death restart is a tick of its own, as it is in GameLoop() */
+    if (ProcessAndDrawPlayer()) return;
+
+    DrawFountains();
+    MoveAndDrawActors();
+    MoveAndDrawShards();
+    MoveAndDrawSpawners();
+    DrawRandomEffects();
+    DrawExplosions();
+    MoveAndDrawDecorations();
+    DrawLights();
+}
+#endif  /* HAS_TICK_STEPPER */
+
+#ifdef TAS_SEARCH
+/*
+Route search tuning. Each decision holds one command for SEARCH_HOLD_TICKS ticks.
+Routes that haven't left the map after SEARCH_MAX_DECISIONS decisions are given
+up on.
+*/
+#define SEARCH_HOLD_TICKS    8
+#define SEARCH_MAX_DECISIONS 150
+#define SEARCH_TABLE_SIZE    1024
+
+/*
+Commands that the search tries at each decision, packed the same way as demo
+data. North is left out; played back from the recorded demo, it would open hint
+globe messages that wait for a key.
+*/
+static byte searchCommands[] = {
+    0x00, 0x01, 0x02, 0x10, 0x11, 0x12, 0x08, 0x20
+};
+#define NUM_SEARCH_COMMANDS (sizeof searchCommands / sizeof searchCommands[0])
+
+#define SNAPSHOT_VAR(var) {&(var), sizeof (var)}
+
+/*
+Every piece of game state that a tick can change, apart from the actors (whose
+count varies) and the map (which is journaled). numActors must be in here.
+*/
+static struct {
+    void *data;
+    word size;
+} snapshotRegions[] = {
+    SNAPSHOT_VAR(winLevel), SNAPSHOT_VAR(gameScore), SNAPSHOT_VAR(gameStars),
+    SNAPSHOT_VAR(playerHealth), SNAPSHOT_VAR(playerHealthCells),
+    SNAPSHOT_VAR(playerBombs), SNAPSHOT_VAR(playerX), SNAPSHOT_VAR(playerY),
+    SNAPSHOT_VAR(scrollX), SNAPSHOT_VAR(scrollY), SNAPSHOT_VAR(playerFaceDir),
+    SNAPSHOT_VAR(playerBaseFrame), SNAPSHOT_VAR(playerFrame),
+    SNAPSHOT_VAR(playerPushForceFrame), SNAPSHOT_VAR(playerClingDir),
+    SNAPSHOT_VAR(canPlayerCling), SNAPSHOT_VAR(isPlayerNearHintGlobe),
+    SNAPSHOT_VAR(isPlayerNearTransporter), SNAPSHOT_VAR(sawAutoHintGlobe),
+    SNAPSHOT_VAR(sawJumpPadBubble), SNAPSHOT_VAR(sawMonumentBubble),
+    SNAPSHOT_VAR(sawScooterBubble), SNAPSHOT_VAR(sawTransporterBubble),
+    SNAPSHOT_VAR(sawPipeBubble), SNAPSHOT_VAR(sawBossBubble),
+    SNAPSHOT_VAR(sawPusherRobotBubble), SNAPSHOT_VAR(sawBearTrapBubble),
+    SNAPSHOT_VAR(sawMysteryWallBubble), SNAPSHOT_VAR(sawTulipLauncherBubble),
+    SNAPSHOT_VAR(sawHamburgerBubble), SNAPSHOT_VAR(sawHurtBubble),
+    SNAPSHOT_VAR(sawBombHint), SNAPSHOT_VAR(sawHealthHint),
+    SNAPSHOT_VAR(pounceHintState), SNAPSHOT_VAR(randomState),
+    SNAPSHOT_VAR(paletteStepCount), SNAPSHOT_VAR(isPlayerInvincible),
+    SNAPSHOT_VAR(playerHurtCooldown), SNAPSHOT_VAR(playerDeadTime),
+    SNAPSHOT_VAR(playerFallDeadTime), SNAPSHOT_VAR(playerRecoilLeft),
+    SNAPSHOT_VAR(isPlayerLongJumping), SNAPSHOT_VAR(isPlayerRecoiling),
+    SNAPSHOT_VAR(isPlayerSlidingEast), SNAPSHOT_VAR(isPlayerSlidingWest),
+    SNAPSHOT_VAR(isPlayerFalling), SNAPSHOT_VAR(playerFallTime),
+    SNAPSHOT_VAR(soundPriority),  /* includes playerJumpTime */
+    SNAPSHOT_VAR(playerPushDir), SNAPSHOT_VAR(playerPushMaxTime),
+    SNAPSHOT_VAR(playerPushTime), SNAPSHOT_VAR(playerPushSpeed),
+    SNAPSHOT_VAR(isPlayerPushAbortable), SNAPSHOT_VAR(isPlayerPushed),
+    SNAPSHOT_VAR(isPlayerPushBlockable), SNAPSHOT_VAR(queuePlayerDizzy),
+    SNAPSHOT_VAR(playerDizzyLeft), SNAPSHOT_VAR(platforms),
+    SNAPSHOT_VAR(fountains), SNAPSHOT_VAR(shards), SNAPSHOT_VAR(explosions),
+    SNAPSHOT_VAR(spawners), SNAPSHOT_VAR(decorations),
+    SNAPSHOT_VAR(decorationFrame), SNAPSHOT_VAR(nextActorIndex),
+    SNAPSHOT_VAR(nextDrawMode), SNAPSHOT_VAR(blockMovementCmds),
+    SNAPSHOT_VAR(cmdJumpLatch), SNAPSHOT_VAR(blockActionCmds),
+    SNAPSHOT_VAR(areForceFieldsActive), SNAPSHOT_VAR(areLightsActive),
+    SNAPSHOT_VAR(arePlatformsActive), SNAPSHOT_VAR(numActors),
+    SNAPSHOT_VAR(numBarrels), SNAPSHOT_VAR(numEyePlants),
+    SNAPSHOT_VAR(pounceStreak), SNAPSHOT_VAR(mysteryWallTime),
+    SNAPSHOT_VAR(activeTransporter), SNAPSHOT_VAR(transporterTimeLeft),
+    SNAPSHOT_VAR(scooterMounted), SNAPSHOT_VAR(isPounceReady),
+    SNAPSHOT_VAR(isPlayerInPipe), SNAPSHOT_VAR(tickStatics),
+    SNAPSHOT_VAR(mapHash)
+};
+#define NUM_SNAPSHOT_REGIONS (sizeof snapshotRegions / sizeof snapshotRegions[0])
+
+/*
+One snapshot per level of the search, indexed by the number of decisions left.
+*/
+static byte *searchSnapshots[TAS_SEARCH + 1];
+static word snapshotJournalLength[TAS_SEARCH + 1];
+
+/*
+Transposition table. Remembers the best score found below a state (identified by
+its HashGameState() hashes), and how many decisions deep that search went.
+*/
+static struct {
+    dword key;
+    long score;
+    word depth;
+} *searchTable;
+
+static dword searchNodeCount;
+
+/*
+Copy the game state into snapshot `slot`.
+*/
+static void SaveSnapshot(word slot)
+{
+    byte *dest = searchSnapshots[slot];
+    word i;
+
+#if defined(DEMO_DESYNC_CHECK) && defined(MAP_CHANGE_LOG)
+    HashMapChanges();
+#endif  /* DEMO_DESYNC_CHECK && MAP_CHANGE_LOG */
+    for (i = 0; i < NUM_SNAPSHOT_REGIONS; i++) {
+        movmem(snapshotRegions[i].data, dest, snapshotRegions[i].size);
+        dest += snapshotRegions[i].size;
+    }
+
+    movmem(actors, dest, numActors * sizeof(Actor));
+
+    snapshotJournalLength[slot] = mapJournalLength;
+    StartMapJournalEpoch();
+}
+
+/*
+Put the game state back the way it was when snapshot `slot` was saved, undoing
+any map changes made since then.
+*/
+static void RestoreSnapshot(word slot)
+{
+    byte *src = searchSnapshots[slot];
+    word i;
+
+    for (i = 0; i < NUM_SNAPSHOT_REGIONS; i++) {
+        movmem(src, snapshotRegions[i].data, snapshotRegions[i].size);
+        src += snapshotRegions[i].size;
+    }
+
+    movmem(src, actors, numActors * sizeof(Actor));
+
+    RollBackMap(snapshotJournalLength[slot]);
+}
+
+/*
+Hold `cmd` for one decision's worth of ticks, stopping early if the level is won
+or the player dies.
+*/
+static void RunSearchCommand(byte cmd)
+{
+    word i;
+
+    for (i = 0; i < SEARCH_HOLD_TICKS; i++) {
+        StepGameTick(cmd);
+
+        if (winLevel || playerDeadTime != 0) break;
+    }
+}
+
+/*
+Scoring hooks. Each returns a measure of how good the current state is in one
+respect, and searchScores[] weighs them against each other.
+*/
+static long ScoreWinLevel(void)
+{
+    return winLevel ? 1 : 0;
+}
+
+static long ScoreDeath(void)
+{
+    return playerDeadTime != 0 ? 1 : 0;
+}
+
+static long ScoreStars(void)
+{
+    return (long)gameStars;
+}
+
+static long ScoreHealth(void)
+{
+    return (long)playerHealth;
+}
+
+/*
+Closeness to the nearest exit sign, if the map has one. Without something like
+this, the search has nothing to go on until an exit is actually in reach.
+*/
+static long ScoreExitDistance(void)
+{
+    long best = 0;
+    word i;
+
+    for (i = 0; i < numActors; i++) {
+        Actor *act = actors + i;
+        long dist;
+
+        if (act->dead || act->sprite != SPR_EXIT_SIGN) continue;
+
+        dist = labs((long)act->x - (long)playerX) + labs((long)act->y - (long)playerY);
+        if (best == 0 || -dist > best) best = -dist;
+    }
+
+    return best;
+}
+
+static struct {
+    long weight;
+    long (*score)(void);
+} searchScores[] = {
+    {100000L, ScoreWinLevel},
+    {-100000L, ScoreDeath},
+    {200L, ScoreStars},
+    {1000L, ScoreHealth},
+    {10L, ScoreExitDistance}
+};
+#define NUM_SEARCH_SCORES (sizeof searchScores / sizeof searchScores[0])
+
+/*
+Combine all the scoring hooks into one score for the current state.
+*/
+static long ScoreSearchState(void)
+{
+    long total = 0;
+    word i;
+
+    for (i = 0; i < NUM_SEARCH_SCORES; i++) {
+        total += searchScores[i].weight * searchScores[i].score();
+    }
+
+    return total;
+}
+
+/*
+Search `depth` decisions ahead of the current state, trying every command at
+each one, and return the best score reachable. Earlier wins score a little
+higher than later ones. The game state is left the way it was found.
+
+At the top level, `best_cmd` receives the command that leads to the best score;
+below that it's NULL.
+*/
+static long SearchNode(word depth, byte *best_cmd)
+{
+    dword hashes[NUM_DESYNC_HASHES];
+    dword key;
+    long score, best = 0;
+    word i, entry;
+
+    score = ScoreSearchState();
+
+    if (winLevel) return score + depth;
+    if (depth == 0 || playerDeadTime != 0) return score;
+
+    HashGameState(hashes);
+    key = HashBytes(0, hashes, sizeof hashes);
+    entry = (word)(key % SEARCH_TABLE_SIZE);
+
+    if (
+        best_cmd == NULL &&
+        searchTable[entry].key == key && searchTable[entry].depth >= depth
+    ) {
+        return searchTable[entry].score;
+    }
+
+    SaveSnapshot(depth);
+
+    for (i = 0; i < NUM_SEARCH_COMMANDS; i++) {
+        if (i != 0) RestoreSnapshot(depth);
+
+        RunSearchCommand(searchCommands[i]);
+        score = SearchNode(depth - 1, NULL);
+        searchNodeCount++;
+
+        if (i == 0 || score > best) {
+            best = score;
+            if (best_cmd != NULL) *best_cmd = searchCommands[i];
+        }
+    }
+
+    RestoreSnapshot(depth);
+
+    searchTable[entry].key = key;
+    searchTable[entry].score = best;
+    searchTable[entry].depth = depth;
+
+    return best;
+}
+
+/*
+Search for a route from the start of `level_num`, recording it as a demo into
+`filename` as it's decided. Returns a string naming how the search ended, and
+the number of decisions made through `decisions`.
+*/
+static char *SearchLevel(word level_num, char *filename, word *decisions)
+{
+    byte cmd;
+
+    InitializeEpisode();
+    levelNum = level_num;
+    SeedRandomState(1);
+
+    StartDemoRecording(filename);
+    if (demoStream == NULL) return "no_file";
+
+    InitializeLevel(level_num);
+    LoadMaskedTileData("MASKTILE.MNI");
+    StopMusic();
+
+    ResetMapJournal();
+
+    for (*decisions = 0; *decisions < SEARCH_MAX_DECISIONS; (*decisions)++) {
+        cmd = searchCommands[0];
+
+        /* Everything here is the root of the search; nothing older is needed */
+        ResetMapJournal();
+
+        {  /* for scope; keep the recording out of the lookahead */
+            FILE *fp = demoStream;
+
+            demoStream = NULL;
+            SearchNode(TAS_SEARCH, &cmd);
+            demoStream = fp;
+        }
+
+        if (isMapJournalFull) break;
+
+        RunSearchCommand(cmd);
+
+        if (winLevel) {
+            SaveDemoData();
+            return "won";
+        }
+
+        if (playerDeadTime != 0) {
+            SaveDemoData();
+            return "died";
+        }
+    }
+
+    SaveDemoData();
+
+    return isMapJournalFull ? "journal_full" : "gave_up";
+}
+
+/*
+Search for a route through each distinct map in the episode and write a summary
+of the results to TAS.JSN.
+*/
+static void RunSearchSuite(void)
+{
+    word i, j;
+    word slot, decisions;
+    word size = MAX_ACTORS * sizeof(Actor);
+    bool soundenabled = isSoundEnabled;
+    bool allocated;
+    char filename[13];
+    char *result;
+    FILE *fp;
+
+    fp = fopen("TAS.JSN", "w");
+    if (fp == NULL) return;
+
+    for (i = 0; i < NUM_SNAPSHOT_REGIONS; i++) {
+        size += snapshotRegions[i].size;
+    }
+
+    searchTable = PROCESS_MALLOC(SEARCH_TABLE_SIZE * sizeof *searchTable);
+    allocated = AllocateMapJournal() && searchTable != NULL;
+
+    for (slot = 0; slot <= TAS_SEARCH; slot++) {
+        searchSnapshots[slot] = PROCESS_MALLOC(size);
+        if (searchSnapshots[slot] == NULL) allocated = false;
+    }
+
+    if (!allocated) {
+        fprintf(fp, "{\n  \"error\": \"not enough memory\"\n}\n");
+        fclose(fp);
+
+        return;
+    }
+
+    memset(searchTable, 0, SEARCH_TABLE_SIZE * sizeof *searchTable);
+
+    fprintf(fp,
+        "{\n  \"episode\": %d,\n  \"version\": \"%s\",\n  \"depth\": %u,\n"
+        "  \"hold_ticks\": %u,\n  \"levels\": [",
+        EPISODE, GAME_VERSION, TAS_SEARCH, SEARCH_HOLD_TICKS
+    );
+
+    isSearchRunning = true;
+    isClockUnthrottled = true;
+    isRenderSuppressed = true;
+    isSoundEnabled = false;
+    demoState = DEMO_STATE_PLAY;
+
+    for (i = 0; i < sizeof(mapNames) / sizeof(mapNames[0]); i++) {
+        /* Bonus maps appear more than once; only search them the first time */
+        for (j = 0; j < i; j++) {
+            if (strcmp(mapNames[i], mapNames[j]) == 0) break;
+        }
+        if (j < i) continue;
+
+        sprintf(filename, "TAS%02u.MNI", i);
+        searchNodeCount = 0;
+        result = SearchLevel(i, filename, &decisions);
+
+        fprintf(fp,
+            "%s\n    {\"level\": %u, \"entry\": \"%s\", \"demo\": \"%s\", "
+            "\"result\": \"%s\", \"ticks\": %lu, \"stars\": %lu, \"health\": %u, "
+            "\"nodes\": %lu}",
+            i == 0 ? "" : ",", i, mapNames[i], filename, result, demoTick, gameStars,
+            playerHealth, searchNodeCount
+        );
     }
 
-    actorwords = getw(fp);  /* total size of actor data, in words */
-    numActors = 0;
-    numPlatforms = 0;
-    numFountains = 0;
-    numLights = 0;
-    areLightsActive = true;
-    hasLightSwitch = false;
+    isSearchRunning = false;
+    isClockUnthrottled = false;
+    isRenderSuppressed = false;
+    isSoundEnabled = soundenabled;
+    demoState = DEMO_STATE_NONE;
+#ifdef SPRITE_CLIP
+    isInFrontMaskValid = false;
+#endif  /* SPRITE_CLIP */
 
-    fread(mapData.w, actorwords, 2, fp);
+    fprintf(fp, "\n  ]\n}\n");
+    fclose(fp);
+}
+#endif  /* TAS_SEARCH */
 
-    for (i = 0; i < actorwords; i += 3) {  /* each actor is 3 words long */
-        register word x, y;
+#ifdef REACHABILITY
+#define REACH_SET_SIZE   4096  /* one bit for each cell of the map */
+#define REACH_QUEUE_SIZE 8192
 
-        t = *(mapData.w + i);
-        x = *(mapData.w + i + 1);
-        y = *(mapData.w + i + 2);
-        NewMapActorAtIndex(numActors, t, x, y);
+/* The same heights that MovePlayer() uses for each tick of a jump */
+static int reachJumpTable[] = {-2, -1, -1, -1, -1, -1, -1, 0};
 
-        if (numActors > MAX_ACTORS - 1) break;
+static byte *reachSets[NUM_REACH_PHASES];
+static dword *reachQueue;
+static word reachQueueHead, reachQueueTail;
+static bool isReachQueueFull;
+
+/*
+Sprite types that the reachability report checks the player can get to.
+*/
+static struct {
+    word sprite;
+    char *name;
+} reachTargets[] = {
+    {SPR_STAR,               "star"},
+    {SPR_HEAD_SWITCH_BLUE,   "blue_switch"},
+    {SPR_HEAD_SWITCH_RED,    "red_switch"},
+    {SPR_HEAD_SWITCH_GREEN,  "green_switch"},
+    {SPR_HEAD_SWITCH_YELLOW, "yellow_switch"},
+    {SPR_TRANSPORTER,        "transporter"},
+    {SPR_EXIT_SIGN,          "exit_sign"},
+    {SPR_EXIT_MONSTER_W,     "exit_monster"},
+    {SPR_EXIT_PLANT,         "exit_plant"}
+};
+#define NUM_REACH_TARGETS (sizeof reachTargets / sizeof reachTargets[0])
+
+/*
+Has the player been found able to reach x,y in any phase of movement?
+*/
+static bool IsReachable(word x, word y)
+{
+    word phase;
+    word cell = x + (y << mapYPower);
+
+    for (phase = 0; phase < NUM_REACH_PHASES; phase++) {
+        if (*(reachSets[phase] + (cell >> 3)) & (1 << (cell & 7))) return true;
+    }
+
+    return false;
+}
+
+/*
+Record that the player can be at x,y in the passed phase of movement, and queue
+it up so the positions that follow from it get explored. Positions that the
+player can't occupy, or that were already reached in that phase, are ignored.
+*/
+static void MarkReachable(word x, word y, word phase)
+{
+    word cell;
+    byte *set;
+
+    /* Same limits as MovePlayer(); the bottom row is where the player dies */
+    if (x < 1 || x > mapWidth - 4 || y < 4 || y >= maxScrollY + SCROLLH) return;
+
+    cell = x + (y << mapYPower);
+    set = reachSets[phase] + (cell >> 3);
+    if (*set & (1 << (cell & 7))) return;
+
+    *set |= 1 << (cell & 7);
+
+    if ((reachQueueTail + 1) % REACH_QUEUE_SIZE == reachQueueHead) {
+        /* Still counts as reached, but nothing beyond it is explored */
+        isReachQueueFull = true;
+
+        return;
+    }
+
+    *(reachQueue + reachQueueTail) = ((dword)phase << 16) | cell;
+    reachQueueTail = (reachQueueTail + 1) % REACH_QUEUE_SIZE;
+}
+
+/*
+Mark every position the player could be in one tick after being at x,y in the
+passed phase of movement, for each combination of walking west/east/neither and
+holding jump or not. This follows the rules in MovePlayer(), but leaves out all
+the movement that comes from actors (pounce recoil, pipes, transporters, etc.)
+*/
+static void ExpandReachable(word x, word y, word phase)
+{
+    int dx;
+    word jump, nx, ny, nphase, horizmove, southmove;
+
+    /* TestPlayerMove() looks at playerY, not just the position it's given */
+    playerY = y;
+
+    if (phase == REACH_GROUND) {
+        TestPlayerMove(DIR4_SOUTH, x, y + 1);  /* used for side effects */
+
+        /* Sliding down a slippery slope happens no matter what is pressed */
+        if (isPlayerSlidingEast != isPlayerSlidingWest) {
+            nx = isPlayerSlidingEast ? x + 1 : x - 1;
+            ny = TestPlayerMove(DIR4_SOUTH, nx, y + 1) == MOVE_FREE ? y + 1 : y;
+            MarkReachable(nx, ny, REACH_GROUND);
+
+            return;
+        }
+    }
+
+    for (dx = -1; dx <= 1; dx++) {
+        for (jump = 0; jump < 2; jump++) {
+            nx = x;
+            ny = y;
+            nphase = phase;
+            playerY = y;
+
+            if (phase == REACH_CLING_WEST || phase == REACH_CLING_EAST) {
+                /* Clinging holds the player in place until jump is pressed */
+                if (!jump) continue;
+
+                nphase = REACH_GROUND;
+            } else if (dx != 0 && x + dx >= 1 && x + dx <= mapWidth - 4) {
+                southmove = TestPlayerMove(DIR4_SOUTH, x, y + 1);
+                nx = x + dx;
+                horizmove = TestPlayerMove(dx < 0 ? DIR4_WEST : DIR4_EAST, nx, ny);
+
+                if (horizmove == MOVE_BLOCKED) {
+                    nx = x;
+
+                    if (canPlayerCling && TestPlayerMove(DIR4_SOUTH, nx, ny + 1) == MOVE_FREE) {
+                        MarkReachable(nx, ny, dx < 0 ? REACH_CLING_WEST : REACH_CLING_EAST);
+
+                        continue;
+                    }
+                } else if (horizmove == MOVE_SLOPED) {
+                    ny--;
+                } else if (
+                    southmove == MOVE_SLOPED &&
+                    TestPlayerMove(DIR4_SOUTH, nx, ny + 1) == MOVE_FREE
+                ) {
+                    ny++;
+                }
+            }
+
+            if (nphase == REACH_GROUND) {
+                if (jump) {
+                    nphase = REACH_JUMP;
+                } else if (TestPlayerMove(DIR4_SOUTH, nx, ny + 1) == MOVE_FREE) {
+                    nphase = REACH_FALL;
+                }
+            } else if (nphase < REACH_FALL && !jump) {
+                nphase = REACH_FALL;
+            }
+
+            if (nphase >= REACH_JUMP && nphase < REACH_FALL) {
+                ny += reachJumpTable[nphase - REACH_JUMP];
+                playerY = ny;
+
+                if (TestPlayerMove(DIR4_NORTH, nx, ny) != MOVE_FREE) {
+                    /* Hit head; start falling from where the tick began */
+                    MarkReachable(nx, ny - reachJumpTable[nphase - REACH_JUMP], REACH_FALL);
+                } else {
+                    MarkReachable(nx, ny, nphase == REACH_JUMP + 7 ? REACH_FALL : nphase + 1);
+                }
+
+                continue;
+            }
+
+            if (nphase >= REACH_FALL) {
+                if (TestPlayerMove(DIR4_SOUTH, nx, ny + 1) != MOVE_FREE) {
+                    nphase = REACH_GROUND;
+                } else if (nphase == REACH_FALL) {
+                    /* The first tick of a fall doesn't actually move down */
+                    nphase++;
+                } else {
+                    ny++;
+
+                    if (nphase < REACH_FALL + 4) {
+                        nphase++;
+                    } else if (TestPlayerMove(DIR4_SOUTH, nx, ny + 1) == MOVE_FREE) {
+                        ny++;
+                    } else {
+                        nphase = REACH_GROUND;
+                    }
+                }
+            }
+
+            MarkReachable(nx, ny, nphase);
+        }
+    }
+}
+
+/*
+Could the player, from any position they can reach, touch the passed actor?
+*/
+static bool IsActorReachable(Actor *act)
+{
+    int x, y;
+    word offset = *(actorInfoData + act->sprite) + (act->frame * 4);
+    word height = *(actorInfoData + offset);
+    word width = *(actorInfoData + offset + 1);
+
+    for (y = (int)act->y - (int)height + 1; y <= (int)act->y + 4; y++) {
+        if (y < 4 || y >= maxScrollY + SCROLLH) continue;
+
+        for (x = (int)act->x - 2; x < (int)(act->x + width); x++) {
+            if (x < 1 || x > mapWidth - 4 || !IsReachable(x, y)) continue;
+
+            playerX = x;
+            playerY = y;
+            if (IsTouchingPlayer(act->sprite, act->frame, act->x, act->y)) return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+Load the passed level's map and explore every position the player could reach
+from the start. Writes a picture of the map to REACHnn.TXT (where `+` marks the
+positions reached, `o` and `X` the targets that can and can't be reached, and
+`#` solid ground) and appends an entry for the level to the summary file.
+*/
+static void AnalyzeLevel(word level_num, FILE *summary)
+{
+    word x, y, i, phase;
+    word startx, starty;
+    word cells = 0;
+    dword entry;
+    char filename[13];
+    char *picture;
+    bool first = true;
+    FILE *fp;
+
+    InitializeMapGlobals();
+    LoadMapData(level_num);
+    startx = playerX;
+    starty = playerY;
+
+    for (phase = 0; phase < NUM_REACH_PHASES; phase++) {
+        memset(reachSets[phase], 0, REACH_SET_SIZE);
+    }
+
+    reachQueueHead = reachQueueTail = 0;
+    isReachQueueFull = false;
+
+    MarkReachable(startx, starty, REACH_FALL);
+
+    while (reachQueueHead != reachQueueTail) {
+        entry = *(reachQueue + reachQueueHead);
+        reachQueueHead = (reachQueueHead + 1) % REACH_QUEUE_SIZE;
+
+        ExpandReachable(
+            (word)entry & (mapWidth - 1), (word)entry >> mapYPower, (word)(entry >> 16)
+        );
+    }
+
+    /* The queue is empty now, so reuse its memory to draw the picture in */
+    picture = (char *)reachQueue;
+
+    for (y = 0; y <= maxScrollY + SCROLLH; y++) {
+        for (x = 0; x < mapWidth; x++) {
+            char c = TILE_BLOCK_SOUTH(MAP_CELL_DATA(x, y)) ? '#' : '.';
+
+            if (x >= 1 && y < maxScrollY + SCROLLH && IsReachable(x, y)) {
+                c = '+';
+                cells++;
+            }
+
+            *(picture + x + (y << mapYPower)) = c;
+        }
+    }
+
+    fprintf(summary,
+        "%s\n    {\"level\": %u, \"entry\": \"%s\", \"start\": [%u, %u], "
+        "\"positions\": %u, \"complete\": %s, \"targets\": [",
+        level_num == 0 ? "" : ",", level_num, mapNames[level_num], startx, starty,
+        cells, isReachQueueFull ? "false" : "true"
+    );
+
+    for (i = 0; i < numActors; i++) {
+        Actor *act = actors + i;
+        word t;
+        bool reached;
+
+        if (act->dead) continue;
+
+        for (t = 0; t < NUM_REACH_TARGETS; t++) {
+            if (act->sprite == reachTargets[t].sprite) break;
+        }
+        if (t == NUM_REACH_TARGETS) continue;
+
+        reached = IsActorReachable(act);
+        *(picture + act->x + (act->y << mapYPower)) = reached ? 'o' : 'X';
+
+        fprintf(summary,
+            "%s\n      {\"type\": \"%s\", \"x\": %u, \"y\": %u, \"reachable\": %s}",
+            first ? "" : ",", reachTargets[t].name, act->x, act->y,
+            reached ? "true" : "false"
+        );
+        first = false;
+    }
+
+    fprintf(summary, "\n    ]}");
+
+    *(picture + startx + (starty << mapYPower)) = 'P';
+
+    sprintf(filename, "REACH%02u.TXT", level_num);
+    fp = fopen(filename, "w");
+    if (fp == NULL) return;
+
+    for (y = 0; y <= maxScrollY + SCROLLH; y++) {
+        fwrite(picture + (y << mapYPower), mapWidth, 1, fp);
+        fputc('\n', fp);
     }
 
-    fread(mapData.b, WORD_MAX, 1, fp);
     fclose(fp);
+}
 
-    for (i = 0; i < numPlatforms; i++) {
-        for (t = 2; t < 7; t++) {
-            /* This is an ugly method of accessing Platform.mapstash */
-            *((word *)(platforms + i) + t) = MAP_CELL_DATA_SHIFTED(
-                platforms[i].x, platforms[i].y, t - 4
+/*
+Explore every distinct map in the episode, writing the picture of each to its
+own REACHnn.TXT file and a summary of all of them to REACH.JSN.
+*/
+static void RunReachabilitySuite(void)
+{
+    word i, j;
+    bool allocated;
+    FILE *fp;
+
+    fp = fopen("REACH.JSN", "w");
+    if (fp == NULL) return;
+
+    reachQueue = PROCESS_MALLOC(REACH_QUEUE_SIZE * sizeof *reachQueue);
+    allocated = reachQueue != NULL;
+
+    for (i = 0; i < NUM_REACH_PHASES; i++) {
+        reachSets[i] = PROCESS_MALLOC(REACH_SET_SIZE);
+        if (reachSets[i] == NULL) allocated = false;
+    }
+
+    if (!allocated) {
+        fprintf(fp, "{\n  \"error\": \"not enough memory\"\n}\n");
+        fclose(fp);
+
+        return;
+    }
+
+    if (!isAdLibPresent) {
+        tileAttributeData = miscData + 5000;
+        miscDataContents = IMAGE_TILEATTR;
+        LoadTileAttributeData("TILEATTR.MNI");
+    }
+
+    fprintf(fp,
+        "{\n  \"episode\": %d,\n  \"version\": \"%s\",\n  \"levels\": [",
+        EPISODE, GAME_VERSION
+    );
+
+    for (i = 0; i < sizeof(mapNames) / sizeof(mapNames[0]); i++) {
+        /* Bonus maps appear more than once; only explore them the first time */
+        for (j = 0; j < i; j++) {
+            if (strcmp(mapNames[i], mapNames[j]) == 0) break;
+        }
+        if (j < i) continue;
+
+        AnalyzeLevel(i, fp);
+    }
+
+    fprintf(fp, "\n  ]\n}\n");
+    fclose(fp);
+}
+#endif  /* REACHABILITY */
+
+#ifdef GOLDEN_TRACE
+/*
+Play back the stream demo `demo_name` while tracing it against (or recording)
+the golden trace `trace_name`, and return a short description of the outcome.
+*/
+static char *TraceDemo(char *demo_name, char *trace_name)
+{
+    FILE *fp = fopen(demo_name, "rb");
+
+    if (fp == NULL) return "demo not found";
+
+    if ((word)getw(fp) != DEMO_STREAM_MAGIC) {
+        fclose(fp);
+
+        return "not a stream demo";
+    }
+
+    traceFp = fopen(trace_name, "rb");
+    isTraceRecording = traceFp == NULL;
+
+    if (isTraceRecording) {
+        traceFp = fopen(trace_name, "wb");
+        if (traceFp == NULL) {
+            fclose(fp);
+
+            return "can't write trace";
+        }
+
+        putw(TRACE_MAGIC, traceFp);
+        putw(NUM_TRACE_FIELDS, traceFp);
+    } else if (
+        (word)getw(traceFp) != TRACE_MAGIC || (word)getw(traceFp) != NUM_TRACE_FIELDS
+    ) {
+        fclose(traceFp);
+        fclose(fp);
+
+        return "trace format differs";
+    }
+
+    memset(traceGolden, 0, NUM_TRACE_FIELDS * sizeof *traceGolden);
+    traceTick = 0;
+    traceDiffField = WORD_MAX;
+    isTraceShort = false;
+
+    InitializeEpisode();
+    StartDemoStream(fp);
+
+    if (demoStream == NULL) {
+        fclose(traceFp);
+
+        return "wrong episode";
+    }
+
+    InitializeLevel(levelNum);
+    LoadMaskedTileData("MASKTILE.MNI");
+
+    isInGame = true;
+    GameLoop(DEMO_STATE_PLAY);
+    isInGame = false;
+
+    StopMusic();
+    fclose(demoStream);
+    demoStream = NULL;
+
+    if (isTraceRecording) {
+        fclose(traceFp);
+
+        return "recorded";
+    }
+
+    if (!isTraceShort && traceDiffField == WORD_MAX && fgetc(traceFp) != EOF) {
+        /* The demo ended before its golden trace did */
+        isTraceShort = true;
+    }
+
+    fclose(traceFp);
+
+    if (traceDiffField != WORD_MAX) return "differs";
+
+    if (isTraceShort) return "length differs";
+
+    return "matches";
+}
+
+/*
+Trace every demo named in TRACE.LST (one file name per line) and write the
+outcome of each to TRACE.JSN. When a traced field differs, the tick, the field,
+and both values are reported.
+*/
+static void RunTraceSuite(void)
+{
+    char demoname[13], tracename[13], fieldname[24];
+    char *result, *dot;
+    bool soundenabled = isSoundEnabled;
+    bool first = true;
+    FILE *list, *fp;
+
+    fp = fopen("TRACE.JSN", "w");
+    if (fp == NULL) return;
+
+    list = fopen("TRACE.LST", "r");
+    traceNow = PROCESS_MALLOC(NUM_TRACE_FIELDS * sizeof *traceNow);
+    traceGolden = PROCESS_MALLOC(NUM_TRACE_FIELDS * sizeof *traceGolden);
+
+    if (list == NULL || traceNow == NULL || traceGolden == NULL) {
+        fprintf(fp, "{\n  \"error\": \"%s\"\n}\n",
+            list == NULL ? "can't read TRACE.LST" : "not enough memory"
+        );
+        fclose(fp);
+
+        return;
+    }
+
+    fprintf(fp,
+        "{\n  \"episode\": %d,\n  \"version\": \"%s\",\n  \"fields\": %u,\n"
+        "  \"demos\": [",
+        EPISODE, GAME_VERSION, (word)NUM_TRACE_FIELDS
+    );
+
+    isTraceRunning = true;
+    isClockUnthrottled = true;
+    isRenderSuppressed = true;
+    isSoundEnabled = false;
+    demoState = DEMO_STATE_PLAY;
+
+    while (fscanf(list, "%12s", demoname) == 1) {
+        strcpy(tracename, demoname);
+        dot = strchr(tracename, '.');
+        if (dot != NULL) *dot = '\0';
+        strcat(tracename, ".TRC");
+
+        result = TraceDemo(demoname, tracename);
+
+        fprintf(fp,
+            "%s\n    {\"demo\": \"%s\", \"trace\": \"%s\", \"result\": \"%s\", "
+            "\"ticks\": %lu",
+            first ? "" : ",", demoname, tracename, result, traceTick
+        );
+        first = false;
+
+        if (traceDiffField != WORD_MAX) {
+            TraceFieldName(traceDiffField, fieldname);
+            fprintf(fp, ", \"field\": \"%s\", \"golden\": %lu, \"now\": %lu",
+                fieldname, traceGolden[traceDiffField], traceNow[traceDiffField]
             );
         }
+
+        fprintf(fp, "}");
     }
 
-    levelNum = level_num;
-    maxScrollY = (word)(0x10000L / (mapWidth * 2)) - (SCROLLH + 1);
+    isTraceRunning = false;
+    isClockUnthrottled = false;
+    isRenderSuppressed = false;
+    isSoundEnabled = soundenabled;
+    demoState = DEMO_STATE_NONE;
+
+    fprintf(fp, "\n  ]\n}\n");
+    fclose(fp);
+    fclose(list);
 }
+#endif  /* GOLDEN_TRACE */
 
+#ifdef AGENT_SERVER
 /*
-Track the backdrop parameters (backdrop number and horizontal/vertical scroll
-flags) and return true if they have changed since the last call. Otherwise
-return false.
+Send one byte to the agent. Unlike SendRelayByte(), this waits for room in the
+send buffer rather than dropping the byte.
 */
-static bbool IsNewBackdrop(word backdrop_num)
+static void SendAgentByte(byte value)
 {
-    static word lastnum = WORD_MAX;
-    static word lasth = WORD_MAX;
-    static word lastv = WORD_MAX;
+    WaitRelaySendRoom(1);
+    SendRelayByte(value);
+}
 
-    if (backdrop_num != lastnum || hasHScrollBackdrop != lasth || hasVScrollBackdrop != lastv) {
-        lastnum = backdrop_num;
-        lasth = hasHScrollBackdrop;
-        lastv = hasVScrollBackdrop;
+/*
+Send one word to the agent, low byte first.
+*/
+static void SendAgentWord(word value)
+{
+    SendAgentByte((byte)value);
+    SendAgentByte(value >> 8);
+}
 
-        return true;
-    }
+/*
+Send the agent an observation of the game as it stands after the last command.
+*/
+static void SendAgentObservation(void)
+{
+    byte flags = 0;
 
-    return false;
+    if (winLevel) flags |= AGENT_LEVEL_WON;
+    if (playerDeadTime != 0) flags |= AGENT_PLAYER_DEAD;
+    if (winGame) flags |= AGENT_GAME_WON;
+
+    SendAgentWord((word)gameScore);
+    SendAgentWord((word)(gameScore >> 16));
+    SendAgentWord(playerHealth - 1);
+    SendAgentWord(playerX);
+    SendAgentWord(playerY);
+    SendAgentByte(flags);
 }
 
+#ifdef TILE_GRID
 /*
-Load the specified backdrop image data into the video memory. Requires a scratch
-buffer twice the size of BACKDROP_SIZE *plus* 640 bytes to perform this work.
-
-Depending on the current backdrop scroll settings, up to four versions of the
-backdrop are copied into EGA video memory. This is due to how the parallax
-scrolling works, which is explained in detail in DrawMapRegion().
+Mark the cells of `grid` (covering the game window) that the box with its
+bottom-left corner at x,y covers with the GRID_* bits in `bits`. The parts of
+the box outside the game window are left out.
 */
-static void LoadBackdropData(char *entry_name, byte *scratch)
+static void MarkTileGrid(word *grid, word x, word y, word width, word height, word bits)
 {
-    FILE *fp = GroupEntryFp(entry_name);
+    word left = x, right = x + width, top = y - height + 1, bottom = y + 1;
+    word row, col;
 
-    EGA_MODE_DEFAULT();
-    EGA_BIT_MASK_DEFAULT();
+    /* Unsigned; anything off the top or left edge wraps around and is clipped */
+    if (x < scrollX) left = scrollX;
+    if (y + 1 < height || top < scrollY) top = scrollY;
+    if (right > scrollX + SCROLLW) right = scrollX + SCROLLW;
+    if (bottom > scrollY + SCROLLH) bottom = scrollY + SCROLLH;
 
-    miscDataContents = IMAGE_NONE;
-    fread(scratch, BACKDROP_SIZE, 1, fp);
+    for (row = top; row < bottom; row++) {
+        word *cell = grid + ((row - scrollY) * SCROLLW) + (left - scrollX);
 
-    /*
-    Copy the unmodified backdrop. This is all we need if there is no backdrop
-    scrolling.
-    */
-    CopyTilesToEGA(scratch, BACKDROP_SIZE_EGA_MEM, EGA_OFFSET_BDROP_EVEN);
+        for (col = left; col < right; col++) {
+            *cell++ |= bits;
+        }
+    }
+}
 
-    if (hasHScrollBackdrop) {
-        /*
-        To do horizontal backdrop scrolling, we need a copy of the backdrop
-        shifted left by 4 pixels.
-        */
-        WrapBackdropHorizontal(scratch, scratch + BACKDROP_SIZE);
-        CopyTilesToEGA(scratch + BACKDROP_SIZE, BACKDROP_SIZE_EGA_MEM, EGA_OFFSET_BDROP_ODD_X);
+/*
+Fill `grid` with SCROLLW x SCROLLH words, row by row, describing the game window
+at its current scroll position. This reads the map and the actors where they
+are, and doesn't draw anything.
+*/
+static void ExtractTileGrid(word *grid)
+{
+    word x, y, i;
+    word *dest = grid;
+
+    for (y = 0; y < SCROLLH; y++) {
+        word *src = &MAP_CELL_DATA(scrollX, scrollY + y);
+
+        for (x = 0; x < SCROLLW; x++) {
+            *dest++ = *(tileAttributeData + (*src++ / 8));
+        }
     }
 
-    if (hasVScrollBackdrop) {
-        /*
-        To do vertical backdrop scrolling, we need a copy of the backdrop
-        shifted up by 4 pixels.
-        */
-        WrapBackdropVertical(scratch, miscData + 5000, scratch + (2 * BACKDROP_SIZE));
-        CopyTilesToEGA(miscData + 5000, BACKDROP_SIZE_EGA_MEM, EGA_OFFSET_BDROP_ODD_Y);
+    for (i = 0; i < numActors; i++) {
+        Actor *act = actors + i;
+        word offset, bits = GRID_ACTOR;
 
-        /*
-        If horizontal scrolling is also enabled, we additionally need one that's
-        shifted both left and up by 4. Here, the assumption is that scratch +
-        BACKDROP_SIZE holds a copy of the backdrop that's already shifted to the
-        left, which will be the case if hasHScrollBackdrop is also true, but not
-        otherwise. This is also why the code just above uses miscData + 5000 to
-        store the shifted copy of the backdrop, instead of using scratch +
-        BACKDROP_SIZE as the horizontal version of this code does.
+        if (act->dead) continue;
 
-        If horizontal scrolling is not enabled, the game still does this, but it
-        will end up operating on random garbage data. However, that doesn't
-        really cause any issues because EGA_OFFSET_BDROP_ODD_XY is never used if
-        horizontal scrolling is not enabled.
-        */
-        WrapBackdropVertical(scratch + BACKDROP_SIZE, miscData + 5000, scratch + (2 * BACKDROP_SIZE));
-        CopyTilesToEGA(miscData + 5000, BACKDROP_SIZE_EGA_MEM, EGA_OFFSET_BDROP_ODD_XY);
+        if (spriteFlags[act->sprite] & SPF_HURTS) bits |= GRID_HAZARD;
+        if (spriteFlags[act->sprite] & SPF_PRIZE) bits |= GRID_PRIZE;
+
+        offset = *(actorInfoData + act->sprite) + (act->frame * 4);
+        MarkTileGrid(
+            grid, act->x, act->y,
+            *(actorInfoData + offset + 1), *(actorInfoData + offset), bits
+        );
     }
 
-    fclose(fp);
+    MarkTileGrid(grid, playerX, playerY, 3, 5, GRID_PLAYER);
 }
+#endif  /* TILE_GRID */
 
 /*
-Reset all of the global variables to prepare for (re)entry into a map. These are
-a mix of player movement variables, actor interactivity flags, and map state.
+Start a new game on `level_num`, set up the same way every time.
 */
-static void InitializeMapGlobals(void)
+static void ResetAgentGame(word level_num)
 {
-    winGame = false;
-    playerClingDir = DIR4_NONE;
-    isPlayerFalling = true;
-    cmdJumpLatch = true;
-    playerJumpTime = 0;
-    playerFallTime = 1;
-    isPlayerRecoiling = false;
-    playerRecoilLeft = 0;
-    playerFaceDir = DIR4_EAST;
-    playerFrame = PLAYER_WALK_1;
-    playerBaseFrame = PLAYER_BASE_EAST;
-    playerDeadTime = 0;
-    winLevel = false;
-    playerHurtCooldown = 40;
-    transporterTimeLeft = 0;
-    activeTransporter = 0;
-    isPlayerInPipe = false;
-    scooterMounted = 0;
-    isPlayerNearTransporter = false;
-    isPlayerNearHintGlobe = false;
-    areForceFieldsActive = true;
-    blockMovementCmds = false;
-
-    ClearPlayerDizzy();
+    InitializeEpisode();
+    levelNum = level_num;
+#ifdef RNG_CONTEXT
+    SeedRandomState(1);
+#endif  /* RNG_CONTEXT */
 
-    blockActionCmds = false;
-    arePlatformsActive = true;
-    isPlayerInvincible = false;
-    paletteStepCount = 0;
-    randStepCount = 0;
-    playerFallDeadTime = 0;
-    sawHurtBubble = false;
-    sawAutoHintGlobe = false;
-    numBarrels = 0;
-    numEyePlants = 0;
-    pounceStreak = 0;
+    InitializeLevel(level_num);
+    LoadMaskedTileData("MASKTILE.MNI");
+    StopMusic();
 
-    sawJumpPadBubble =
-        sawMonumentBubble =
-        sawScooterBubble =
-        sawTransporterBubble =
-        sawPipeBubble =
-        sawBossBubble =
-        sawPusherRobotBubble =
-        sawBearTrapBubble =
-        sawMysteryWallBubble =
-        sawTulipLauncherBubble =
-        sawHamburgerBubble = false;
+    winLevel = false;
+    winGame = false;
 }
 
 /*
-Switch to a new level (or reload the current one) and perform all related
-initialization tasks.
+Let an agent on the other end of the serial port play the game, one command at
+a time, until it sends AGENT_CMD_QUIT or Esc is pressed here. The game starts
+out on the first level. A level that is won stays that way until the agent
+resets it; step commands in between run nothing and are answered with the same
+observation. A lost life restarts the level as it normally would.
+
+#ifdef TILE_GRID: The agent can also ask for a tile grid of the game window.
 */
-void InitializeLevel(word level_num)
+static void RunAgentServer(void)
 {
-    static word mapVariables, musicNum;
-    FILE *fp;
-    word bdnum;
-
-    if (level_num == 0 && isNewGame) {
-        DrawFullscreenImage(IMAGE_ONE_MOMENT);
-        /* All my childhood, I wondered what it was doing here. It's bupkis. */
-        WaitSoft(300);
-    } else {
-        FadeOut();
-    }
-
-    fp = GroupEntryFp(mapNames[level_num]);
-    mapVariables = getw(fp);
-    fclose(fp);
+    bool soundenabled = isSoundEnabled;
+    int cmd, arg;
+#ifdef TILE_GRID
+    static word grid[SCROLLW * SCROLLH];
+#endif  /* TILE_GRID */
 
-    StopMusic();
+    OpenRelayPort();
 
-    hasRain = (bool)(mapVariables & 0x0020);
-    bdnum = mapVariables & 0x001f;
-    hasHScrollBackdrop = (bool)(mapVariables & 0x0040);
-    hasVScrollBackdrop = (bool)(mapVariables & 0x0080);
-    paletteAnimationNum = (byte)(mapVariables >> 8) & 0x07;
-    musicNum = (mapVariables >> 11) & 0x001f;
+    isClockUnthrottled = true;
+    isRenderSuppressed = true;
+    isSoundEnabled = false;
+    demoState = DEMO_STATE_PLAY;  /* skips the level intros */
 
-    InitializeMapGlobals();
+    ResetAgentGame(0);
 
-    if (IsNewBackdrop(bdnum)) {
-        LoadBackdropData(backdropNames[bdnum], mapData.b);
-    }
+    while ((cmd = WaitRelayByte()) != -1 && cmd != AGENT_CMD_QUIT) {
+#ifdef TILE_GRID
+        if (cmd == AGENT_CMD_GRID) {
+            word i;
 
-    LoadMapData(level_num);
+            ExtractTileGrid(grid);
 
-    if (level_num == 0 && isNewGame) {
-        FadeOut();
-        isNewGame = false;
-    }
+            for (i = 0; i < SCROLLW * SCROLLH; i++) {
+                SendAgentWord(grid[i]);
+            }
 
-    if (demoState == DEMO_STATE_NONE) {
-        switch (level_num) {
-        case 0:
-        case 1:
-        case 4:
-        case 5:
-        case 8:
-        case 9:
-        case 12:
-        case 13:
-        case 16:
-        case 17:
-            SelectDrawPage(0);
-            SelectActivePage(0);
-            ClearScreen();
-            FadeIn();
-            ShowLevelIntro(level_num);
-            WaitSoft(150);
-            FadeOut();
-            break;
+            continue;
         }
-    }
 
-    InitializeShards();
-    InitializeExplosions();
-    InitializeDecorations();
-    ClearPlayerPush();
-    InitializeSpawners();
+#endif  /* TILE_GRID */
+        if (cmd != AGENT_CMD_RESET && cmd != AGENT_CMD_STEP) continue;
 
-    ClearGameScreen();
-    SelectDrawPage(activePage);
-    activePage = !activePage;
-    SelectActivePage(activePage);
+        if ((arg = WaitRelayByte()) == -1) break;
 
-    SaveGameState('T');
-    StartGameMusic(musicNum);
+        if (cmd == AGENT_CMD_RESET) {
+            ResetAgentGame(arg < sizeof(mapNames) / sizeof(mapNames[0]) ? arg : 0);
+        } else if (!winLevel && !winGame) {
+            StepGameTick((byte)arg);
+        }
 
-    if (!isAdLibPresent) {
-        tileAttributeData = miscData + 5000;
-        miscDataContents = IMAGE_TILEATTR;
-        LoadTileAttributeData("TILEATTR.MNI");
+        SendAgentObservation();
     }
 
-    FadeIn();
-
-#ifdef EXPLOSION_PALETTE
-    if (paletteAnimationNum == PAL_ANIM_EXPLOSIONS) {
-        SetPaletteRegister(PALETTE_KEY_INDEX, MODE1_BLACK);
-    }
-#endif  /* EXPLOSION_PALETTE */
-}
+    /* Let the last observation finish going out */
+    while (relaySendHead != relaySendTail)
+        ;  /* VOID */
 
-/*
-Set all variables that pertain to the state of the overarching game. These are
-set once at the beginning of each episode and retain their values across levels.
-*/
-void InitializeEpisode(void)
-{
-    gameScore = 0;
-    playerHealth = 4;
-    playerHealthCells = 3;
-    levelNum = 0;
-    playerBombs = 0;
-    gameStars = 0;
-    demoDataPos = 0;
-    demoDataLength = 0;
-    usedCheatCode = false;
-    sawBombHint = false;
-    sawHealthHint = false;
+    isClockUnthrottled = false;
+    isRenderSuppressed = false;
+    isSoundEnabled = soundenabled;
+    demoState = DEMO_STATE_NONE;
+#ifdef SPRITE_CLIP
+    isInFrontMaskValid = false;
+#endif  /* SPRITE_CLIP */
 }
+#endif  /* AGENT_SERVER */
 
 /*
 Main entry point for the game, after the 80286 processor test has passed. This
 function never returns; the only way to end the program is for something within
 the loop to call ExitClean() or a similar function to request termination.
+
+#ifdef BENCHMARK: Runs the benchmark suite and exits instead of entering the loop.
+#ifdef TAS_SEARCH: Likewise, runs the route search and exits.
+#ifdef REACHABILITY: Likewise, runs the reachability analyzer and exits.
+#ifdef GOLDEN_TRACE: Likewise, traces the demos in TRACE.LST and exits.
+#ifdef AGENT_SERVER: Likewise, serves an agent through the serial port and exits.
 */
 void InnerMain(int argc, char *argv[])
 {
@@ -10604,20 +15213,83 @@ void InnerMain(int argc, char *argv[])
 
     Startup();
 
+#ifdef BENCHMARK
+    RunBenchmarkSuite();
+#endif  /* BENCHMARK */
+#ifdef TAS_SEARCH
+    RunSearchSuite();
+#endif  /* TAS_SEARCH */
+#ifdef REACHABILITY
+    RunReachabilitySuite();
+#endif  /* REACHABILITY */
+#ifdef GOLDEN_TRACE
+    RunTraceSuite();
+#endif  /* GOLDEN_TRACE */
+#ifdef AGENT_SERVER
+    RunAgentServer();
+#endif  /* AGENT_SERVER */
+#ifdef HAS_HEADLESS_MODE
+    ExitClean();
+
+#endif  /* HAS_HEADLESS_MODE */
     for (;;) {
         demoState = TitleLoop();
 
+#ifdef DEMO_STREAM
+        /* The stream header can change the level, so this has to go first. */
+        if (demoState == DEMO_STATE_PLAY) {
+#ifdef SPECTATOR_RELAY
+            if (isSpectating) {
+                if (!StartSpectating()) continue;
+            } else {
+                LoadDemoData();
+            }
+#else
+            LoadDemoData();
+#endif  /* SPECTATOR_RELAY */
+        } else if (demoState == DEMO_STATE_RECORD) {
+            /* Recording goes to the same file name that LoadDemoData() reads */
+            StartDemoRecording("PREVDEMO.MNI");
+        }
+
+#endif  /* DEMO_STREAM */
+#ifdef SPECTATOR_RELAY
+        StartRelay(levelNum);
+#endif  /* SPECTATOR_RELAY */
         InitializeLevel(levelNum);
         LoadMaskedTileData("MASKTILE.MNI");
 
+#ifndef DEMO_STREAM
         if (demoState == DEMO_STATE_PLAY) {
             LoadDemoData();
         }
 
+#endif  /* DEMO_STREAM */
         isInGame = true;
         GameLoop(demoState);
         isInGame = false;
 
+#ifdef SPECTATOR_RELAY
+        if (demoState == DEMO_STATE_NONE) {
+            WaitRelaySendRoom(1);
+            SendRelayByte(DEMO_TAG_END);
+        }
+
+        isSpectating = false;
+
+#endif  /* SPECTATOR_RELAY */
+#ifdef FAST_FORWARD
+        SetClockSpeed(CLOCK_NORMAL);
+
+#endif  /* FAST_FORWARD */
+#ifdef DEMO_STREAM
+        if (demoState == DEMO_STATE_PLAY && demoStream != NULL) {
+            fclose(demoStream);
+            demoStream = NULL;
+        }
+
+#endif  /* DEMO_STREAM */
+
         StopMusic();
 
         if (demoState != DEMO_STATE_PLAY && demoState != DEMO_STATE_RECORD) {
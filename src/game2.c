@@ -120,7 +120,20 @@ Joystick calibration/button options. Supports two joysticks identified by index
 static int joystickBandLeft[3], joystickBandRight[3];
 static int joystickBandTop[3], joystickBandBottom[3];
 static bool joystickBtn1Bombs;
+#ifdef QUICK_JOYSTICK
+static bool hasJoystickCalibration = false;
+#endif  /* QUICK_JOYSTICK */
 
+#ifdef HAS_INTERRUPT_CLOCK
+/*
+Count of timer interrupts since startup, and how many of them occur per second.
+Its resolution is the interrupt rate: 1/560 of a second with the AdLib enabled,
+1/140 without. ReadPreciseClock() goes finer than that.
+*/
+dword interruptClock = 0;
+word interruptClockRate;
+
+#endif  /* HAS_INTERRUPT_CLOCK */
 /*
 Junk variables. Some are read/written, others are padding, none are important.
 The ones declared non-static are to avoid "never used" warnings.
@@ -158,7 +171,15 @@ static void SetPIT0Value(word value)
     xxxx011x    | Mode 3: Square wave generator
     xxxxxxx0    | 16-bit binary counting mode
     */
+#ifdef BENCHMARK
+    /*
+    Mode 2 (rate generator) interrupts just as often, but counts straight down
+    once per period, so ReadPreciseClock() can tell how far along it is.
+    */
+    outportb(0x0043, 0x34);
+#else
     outportb(0x0043, 0x36);
+#endif  /* BENCHMARK */
 
     /* PIT counter 0 divisor (low, high byte) */
     outportb(0x0040, value);
@@ -423,6 +444,9 @@ static void interrupt TimerInterruptService(void)
     static word count = 1;
 
     junk1++;
+#ifdef HAS_INTERRUPT_CLOCK
+    interruptClock++;
+#endif  /* HAS_INTERRUPT_CLOCK */
 
     if (isAdLibServiceRunning == true) {  /* explicit compare against 1 */
         AdLibService();
@@ -470,9 +494,45 @@ static void InitializeInterruptRate(void)
         rate = 140;
     }
 
+#ifdef HAS_INTERRUPT_CLOCK
+    interruptClockRate = rate;
+#endif  /* HAS_INTERRUPT_CLOCK */
     SetInterruptRate(rate);
 }
 
+#ifdef BENCHMARK
+/*
+Return the time since startup in timer chip input clocks (1,193,182 per second),
+by latching how far timer channel 0 has counted into the current interrupt.
+*/
+dword ReadPreciseClock(void)
+{
+    dword clock;
+    word count;
+
+    disable();
+
+    outportb(0x0043, 0x00);  /* latch counter 0 */
+    count = inportb(0x0040);
+    count |= inportb(0x0040) << 8;
+    clock = interruptClock;
+
+    /*
+    If the counter reloaded while interrupts were held off, the interrupt that
+    counts that is still waiting in the interrupt controller. The count is then
+    close to the top, and the clock has to be bumped here instead.
+    */
+    outportb(0x0020, 0x0a);  /* read interrupt request register */
+    if ((inportb(0x0020) & 0x01) && count > (word)(pit0Value / 2)) {
+        clock++;
+    }
+
+    enable();
+
+    return (clock * pit0Value) + (pit0Value - count);
+}
+#endif  /* BENCHMARK */
+
 /*
 Handle global changes to the music state. [ID_SD, SD_SetMusicMode()]
 */
@@ -637,9 +697,16 @@ void FadeOutAdLibPlayback(void)
 Wait until `delay` timer ticks have passed, then return.
 
 Delay units are 1/140 of a second.
+
+#ifdef HAS_VIRTUAL_CLOCK: Returns immediately while the game clock is unthrottled
+(during benchmarks, route searches, and traces, or by fast-forward).
 */
 void WaitHard(word delay)
 {
+#ifdef HAS_VIRTUAL_CLOCK
+    if (isClockUnthrottled) return;
+
+#endif  /* HAS_VIRTUAL_CLOCK */
     gameTickCount = 0;
 
     while (gameTickCount < delay)
@@ -654,9 +721,16 @@ Delay units are 1/140 of a second.
 This function responds to "key down" events, and expects the most recent event
 in the keyboard buffer to have been a "key up" event. If a key is already being
 held down during entry to this function, it will return immediately.
+
+#ifdef HAS_VIRTUAL_CLOCK: Also returns immediately while the game clock is
+unthrottled.
 */
 void WaitSoft(word delay)
 {
+#ifdef HAS_VIRTUAL_CLOCK
+    if (isClockUnthrottled) return;
+
+#endif  /* HAS_VIRTUAL_CLOCK */
     gameTickCount = 0;
 
     do {
@@ -815,13 +889,58 @@ void ClearScreen(void)
     }
 }
 
+#ifdef QUICK_JOYSTICK
+/*
+Poll for the X,Y position of the specified joystick, but stop timing each axis
+once its timer goes past the given limit. An axis that was cut off reads as its
+limit plus one.
+*/
+static void ReadJoystickTimesUpTo(
+    word stick_num, int *x_time, int *y_time, int x_limit, int y_limit
+) {
+    word xmask, ymask;
+
+    if (stick_num == JOYSTICK_A) {
+        xmask = 0x0001;
+        ymask = 0x0002;
+    } else {  /* JOYSTICK_B */
+        xmask = 0x0004;
+        ymask = 0x0008;
+    }
+
+    *x_time = 0;
+    *y_time = 0;
+
+    outportb(0x0201, inportb(0x0201));
+
+    for (;;) {
+        word data = inportb(0x0201);
+
+        if (*x_time > x_limit) data &= ~xmask;
+        if (*y_time > y_limit) data &= ~ymask;
+
+        if ((data & (xmask | ymask)) == 0) break;
+
+        *x_time += (data & xmask) != 0;
+        *y_time += (data & ymask) != 0;
+    }
+}
+#endif  /* QUICK_JOYSTICK */
+
 /*
 Poll for the X,Y position of the specified joystick, and store the result into
 the two provided timer pointers. If either timer exceeds 500 polls, abort.
 [IDLIB, ReadJoystick()]
+
+#ifdef QUICK_JOYSTICK: This uses ReadJoystickTimesUpTo(), which cuts off each
+axis on its own. Calibration has to count in the same loop that play does, or
+every band would be off.
 */
 static void ReadJoystickTimes(word stick_num, int *x_time, int *y_time)
 {
+#ifdef QUICK_JOYSTICK
+    ReadJoystickTimesUpTo(stick_num, x_time, y_time, 500, 500);
+#else
     word xmask, ymask;
 
     if (stick_num == JOYSTICK_A) {
@@ -847,8 +966,27 @@ static void ReadJoystickTimes(word stick_num, int *x_time, int *y_time)
 
         if (xwaiting + ywaiting == 0) break;
     } while (*x_time < 500 && *y_time < 500);
+#endif  /* QUICK_JOYSTICK */
 }
 
+#ifdef QUICK_JOYSTICK
+/*
+Return true if a joystick calibration was measured or loaded from the
+configuration file, and joystick A is plugged in to use it. A joystick that is
+not there never finishes counting.
+*/
+bool IsJoystickCalibrationUsable(void)
+{
+    int xtime, ytime;
+
+    if (!hasJoystickCalibration) return false;
+
+    ReadJoystickTimes(JOYSTICK_A, &xtime, &ytime);
+
+    return xtime <= 500 && ytime <= 500;
+}
+#endif  /* QUICK_JOYSTICK */
+
 /*
 Translate raw timer data from the joystick into movement commands, taking into
 account the current joystick calibration values and button swap configuration.
@@ -862,7 +1000,15 @@ JoystickState ReadJoystickState(word stick_num)
     word buttons;
     JoystickState state;
 
+#ifdef QUICK_JOYSTICK
+    /* Past the right and bottom bands, the exact time makes no difference */
+    ReadJoystickTimesUpTo(
+        stick_num, &xtime, &ytime,
+        joystickBandRight[stick_num], joystickBandBottom[stick_num]
+    );
+#else
     ReadJoystickTimes(stick_num, &xtime, &ytime);
+#endif  /* QUICK_JOYSTICK */
 
     /*
     This is really, really a bitwise OR instead of logical. Whether this was
@@ -1023,6 +1169,10 @@ word UnfoldTextFrame(
     word size;  /* current width or height */
     int i;  /* current left or top position */
 
+#ifdef INPUT_EVENTS
+    wasDialogShown = true;
+
+#endif  /* INPUT_EVENTS */
     /* Expand horizontally... */
     size = 1;
     for (i = xcenter; i > left; i--) {
@@ -1180,6 +1330,9 @@ static void ShowJoystickConfiguration(word stick_num)
     }
 
     isJoystickReady = true;
+#ifdef QUICK_JOYSTICK
+    hasJoystickCalibration = true;
+#endif  /* QUICK_JOYSTICK */
 }
 
 /*
@@ -1204,6 +1357,7 @@ void DrawNumberFlushRight(word x_origin, word y_origin, dword value)
     }
 }
 
+#ifndef LAZY_STATUS_BAR
 /*
 Add `points` to the player's score, then redraw that area of the status bar.
 This function does not know where that x/y position on the screen is, so those
@@ -1359,6 +1513,172 @@ void UpdateHealth(void)
     DrawSBarHealthHelper();
 }
 
+#else
+
+/*
+Status bar areas that have changed since they were last drawn, as a combination
+of STATUS_* bits. Nothing is drawn until FlushStatusBar() is called.
+*/
+static byte statusDirty = STATUS_ALL;
+
+#ifndef DEBUG_BAR
+/*
+What the status bar currently shows on both video pages, as of the last call to
+FlushStatusBar(). While `isStatusBarDrawn` is false, none of this is trusted and
+every area is drawn in full.
+*/
+static bool isStatusBarDrawn = false;
+static char statusScoreText[12];
+static char statusStarsText[12];
+static word statusBombs;
+static word statusHealth;
+static word statusHealthCells;
+#endif  /* DEBUG_BAR */
+
+/*
+Add `points` to the player's score, and mark that area of the status bar for
+redrawing.
+*/
+void AddScore(dword points)
+{
+    gameScore += points;
+    statusDirty |= STATUS_SCORE;
+}
+
+/*
+Mark the "Stars" area of the status bar for redrawing.
+*/
+void UpdateStars(void)
+{
+    statusDirty |= STATUS_STARS;
+}
+
+/*
+Mark the "Bombs" area of the status bar for redrawing.
+*/
+void UpdateBombs(void)
+{
+    statusDirty |= STATUS_BOMBS;
+}
+
+/*
+Mark the "Health" area of the status bar for redrawing.
+*/
+void UpdateHealth(void)
+{
+    statusDirty |= STATUS_HEALTH;
+}
+
+#ifndef DEBUG_BAR
+/*
+Draw the digits in `text` flush right at {x,y}_origin on the current draw page,
+the same way DrawNumberFlushRight() would. Digits that match the ones in `old`
+(the text that was previously drawn there) are already on the screen, and they
+are skipped.
+*/
+static void DrawChangedDigits(
+    word x_origin, word y_origin, char *text, char *old
+) {
+    int x, length = strlen(text), old_length = strlen(old);
+
+    for (x = length - 1; x >= 0; x--) {
+        char digit = text[length - x - 1];
+
+        if (x < old_length && old[old_length - x - 1] == digit) continue;
+
+        DrawSpriteTile(fontTileData + FONT_0 + ((digit - '0') * 40), x_origin - x, y_origin);
+    }
+}
+
+/*
+Draw the health cells at {x,y}_origin on the current draw page, skipping the
+ones that look the same as they did with the previously drawn values.
+*/
+static void DrawChangedHealth(word x_origin, word y_origin)
+{
+    word cell;
+
+    for (cell = 0; cell < playerHealthCells; cell++) {
+        bool full = playerHealth - 1 > cell;
+
+        if (cell >= 8) continue;
+
+        if (
+            isStatusBarDrawn && cell < statusHealthCells &&
+            (statusHealth - 1 > cell) == full
+        ) continue;
+
+        if (full) {
+            DrawSpriteTile(fontTileData + FONT_UPPER_BAR_1, x_origin - cell, y_origin);
+            DrawSpriteTile(fontTileData + FONT_LOWER_BAR_1, x_origin - cell, y_origin + 1);
+        } else {
+            DrawSpriteTile(fontTileData + FONT_UPPER_BAR_0, x_origin - cell, y_origin);
+            DrawSpriteTile(fontTileData + FONT_LOWER_BAR_0, x_origin - cell, y_origin + 1);
+        }
+    }
+}
+#endif  /* DEBUG_BAR */
+
+/*
+Redraw every area of the status bar that has changed since the last call, on
+both video pages. However many times the values changed in between, each area
+is converted and drawn once, and only the digits and health cells that differ
+from what is already on the screen are touched.
+*/
+void FlushStatusBar(void)
+{
+#ifndef DEBUG_BAR
+    char score_text[12], stars_text[12];
+    word page;
+
+    if (statusDirty == 0) return;
+
+    if (!isStatusBarDrawn) {
+        statusScoreText[0] = '\0';
+        statusStarsText[0] = '\0';
+        statusDirty = STATUS_ALL;
+    }
+
+    ultoa(gameScore, score_text, 10);
+    ultoa((word)gameStars, stars_text, 10);
+
+    EGA_MODE_DEFAULT();
+
+    for (page = 0; page < 2; page++) {
+        SelectDrawPage(page == 0 ? activePage : !activePage);
+
+        if (statusDirty & STATUS_SCORE) {
+            DrawChangedDigits(9, 22, score_text, statusScoreText);
+        }
+
+        if (statusDirty & STATUS_STARS) {
+            DrawChangedDigits(35, 22, stars_text, statusStarsText);
+        }
+
+        if ((statusDirty & STATUS_BOMBS) && !(isStatusBarDrawn && statusBombs == playerBombs)) {
+            DrawSpriteTile(fontTileData + FONT_BACKGROUND_GRAY, 24, 23);
+            DrawNumberFlushRight(24, 23, playerBombs);
+        }
+
+        if (statusDirty & STATUS_HEALTH) {
+            DrawChangedHealth(17, 22);
+        }
+    }
+
+    EGA_MODE_LATCHED_WRITE();
+
+    strcpy(statusScoreText, score_text);
+    strcpy(statusStarsText, stars_text);
+    statusBombs = playerBombs;
+    statusHealth = playerHealth;
+    statusHealthCells = playerHealthCells;
+    isStatusBarDrawn = true;
+#endif  /* DEBUG_BAR */
+
+    statusDirty = 0;
+}
+#endif  /* LAZY_STATUS_BAR */
+
 /*
 Display the high score table, with an option to zero out all the scores by
 pressing F10. This does not restore the Simpsons names like deleting the config
@@ -1753,16 +2073,16 @@ void ShowStory(void)
     ClearScreen();
 
     x = UnfoldTextFrame(1, 23, 38, "STORY", "Press ANY key.");
-    DrawTextLine(x + 1,  8,  "\xFB""000");
-    DrawTextLine(x + 1,  20, "\xFB""002");
-    DrawTextLine(x + 16, 5,  "Tomorrow is Cosmo's");
-    DrawTextLine(x + 16, 7,  "birthday, and his");
-    DrawTextLine(x + 16, 9,  "parents are taking");
-    DrawTextLine(x + 16, 11, "him to the one place");
-    DrawTextLine(x + 16, 13, "in the Milky Way");
-    DrawTextLine(x + 16, 15, "galaxy that all kids");
-    DrawTextLine(x + 16, 17, "would love to go to:");
-    DrawTextLine(x + 16, 19, "   Disney World!");
+    DrawStaticTextLine(x + 1,  8,  "\xFB""000");
+    DrawStaticTextLine(x + 1,  20, "\xFB""002");
+    DrawStaticTextLine(x + 16, 5,  "Tomorrow is Cosmo's");
+    DrawStaticTextLine(x + 16, 7,  "birthday, and his");
+    DrawStaticTextLine(x + 16, 9,  "parents are taking");
+    DrawStaticTextLine(x + 16, 11, "him to the one place");
+    DrawStaticTextLine(x + 16, 13, "in the Milky Way");
+    DrawStaticTextLine(x + 16, 15, "galaxy that all kids");
+    DrawStaticTextLine(x + 16, 17, "would love to go to:");
+    DrawStaticTextLine(x + 16, 19, "   Disney World!");
     FadeIn();
     WaitSpinner(x + 35, 22);
 
@@ -1770,13 +2090,13 @@ void ShowStory(void)
     ClearScreen();
 
     x = UnfoldTextFrame(1, 23, 38, "STORY", "Press ANY key.");
-    DrawTextLine(x + 3,  12, "\xFB""003");
-    DrawTextLine(x + 25, 12, "\xFB""004");
-    DrawTextLine(x + 3,  5,  "Suddenly a blazing comet zooms");
-    DrawTextLine(x + 4,  7,  "toward their ship--leaving no");
-    DrawTextLine(x + 16, 10, "time");
-    DrawTextLine(x + 17, 12, "to");
-    DrawTextLine(x + 10, 15, "change course...");
+    DrawStaticTextLine(x + 3,  12, "\xFB""003");
+    DrawStaticTextLine(x + 25, 12, "\xFB""004");
+    DrawStaticTextLine(x + 3,  5,  "Suddenly a blazing comet zooms");
+    DrawStaticTextLine(x + 4,  7,  "toward their ship--leaving no");
+    DrawStaticTextLine(x + 16, 10, "time");
+    DrawStaticTextLine(x + 17, 12, "to");
+    DrawStaticTextLine(x + 10, 15, "change course...");
     FadeIn();
     WaitSpinner(x + 35, 22);
 
@@ -1784,14 +2104,14 @@ void ShowStory(void)
     ClearScreen();
 
     x = UnfoldTextFrame(1, 23, 38, "STORY", "Press ANY key.");
-    DrawTextLine(x + 2,  7,  "\xFB""005");
-    DrawTextLine(x + 25, 20, "\xFB""006");
-    DrawTextLine(x + 15, 7,  "The comet slams into");
-    DrawTextLine(x + 1,  10, "the ship and forces Cosmo's");
-    DrawTextLine(x + 1,  13, "dad to make an");
-    DrawTextLine(x + 1,  15, "emergency landing");
-    DrawTextLine(x + 1,  17, "on an uncharted");
-    DrawTextLine(x + 1,  19, "planet.");
+    DrawStaticTextLine(x + 2,  7,  "\xFB""005");
+    DrawStaticTextLine(x + 25, 20, "\xFB""006");
+    DrawStaticTextLine(x + 15, 7,  "The comet slams into");
+    DrawStaticTextLine(x + 1,  10, "the ship and forces Cosmo's");
+    DrawStaticTextLine(x + 1,  13, "dad to make an");
+    DrawStaticTextLine(x + 1,  15, "emergency landing");
+    DrawStaticTextLine(x + 1,  17, "on an uncharted");
+    DrawStaticTextLine(x + 1,  19, "planet.");
     FadeIn();
     WaitSpinner(x + 35, 22);
 
@@ -1799,14 +2119,14 @@ void ShowStory(void)
     ClearScreen();
 
     x = UnfoldTextFrame(1, 23, 38, "STORY", "Press ANY key.");
-    DrawTextLine(x + 17, 9,  "\xFB""007");
-    DrawTextLine(x + 1,  20, "\xFB""008");
-    DrawTextLine(x + 2,  5,  "While Cosmo's");
-    DrawTextLine(x + 2,  7,  "dad repairs");
-    DrawTextLine(x + 2,  9,  "the ship,");
-    DrawTextLine(x + 11, 15, "Cosmo heads off to");
-    DrawTextLine(x + 11, 17, "explore and have");
-    DrawTextLine(x + 11, 19, "some fun.");
+    DrawStaticTextLine(x + 17, 9,  "\xFB""007");
+    DrawStaticTextLine(x + 1,  20, "\xFB""008");
+    DrawStaticTextLine(x + 2,  5,  "While Cosmo's");
+    DrawStaticTextLine(x + 2,  7,  "dad repairs");
+    DrawStaticTextLine(x + 2,  9,  "the ship,");
+    DrawStaticTextLine(x + 11, 15, "Cosmo heads off to");
+    DrawStaticTextLine(x + 11, 17, "explore and have");
+    DrawStaticTextLine(x + 11, 19, "some fun.");
     FadeIn();
     WaitSpinner(x + 35, 22);
 
@@ -1814,12 +2134,12 @@ void ShowStory(void)
     ClearScreen();
 
     x = UnfoldTextFrame(1, 23, 38, "STORY", "Press ANY key.");
-    DrawTextLine(x + 3,  15, "\xFB""009");
-    DrawTextLine(x + 6,  7,  "Returning an hour later,");
-    DrawTextLine(x + 17, 11, "Cosmo cannot find");
-    DrawTextLine(x + 17, 13, "his Mom or Dad.");
-    DrawTextLine(x + 17, 15, "Instead, he finds");
-    DrawTextLine(x + 8,  18, "strange foot prints...");
+    DrawStaticTextLine(x + 3,  15, "\xFB""009");
+    DrawStaticTextLine(x + 6,  7,  "Returning an hour later,");
+    DrawStaticTextLine(x + 17, 11, "Cosmo cannot find");
+    DrawStaticTextLine(x + 17, 13, "his Mom or Dad.");
+    DrawStaticTextLine(x + 17, 15, "Instead, he finds");
+    DrawStaticTextLine(x + 8,  18, "strange foot prints...");
     FadeIn();
     WaitSpinner(x + 35, 22);
 
@@ -1827,15 +2147,15 @@ void ShowStory(void)
     ClearScreen();
 
     x = UnfoldTextFrame(1, 23, 38, "STORY", "Press ANY key.");
-    DrawTextLine(x + 21, 19, "\xFB""010");
-    DrawTextLine(x + 2,  5,  "...oh no!  Has his");
-    DrawTextLine(x + 2,  7,  "family been taken");
-    DrawTextLine(x + 2,  9,  "away by a hungry");
-    DrawTextLine(x + 2,  11, "alien creature to");
-    DrawTextLine(x + 2,  13, "be eaten?  Cosmo");
-    DrawTextLine(x + 2,  15, "must rescue his");
-    DrawTextLine(x + 2,  17, "parents before");
-    DrawTextLine(x + 2,  19, "it's too late...!");
+    DrawStaticTextLine(x + 21, 19, "\xFB""010");
+    DrawStaticTextLine(x + 2,  5,  "...oh no!  Has his");
+    DrawStaticTextLine(x + 2,  7,  "family been taken");
+    DrawStaticTextLine(x + 2,  9,  "away by a hungry");
+    DrawStaticTextLine(x + 2,  11, "alien creature to");
+    DrawStaticTextLine(x + 2,  13, "be eaten?  Cosmo");
+    DrawStaticTextLine(x + 2,  15, "must rescue his");
+    DrawStaticTextLine(x + 2,  17, "parents before");
+    DrawStaticTextLine(x + 2,  19, "it's too late...!");
     FadeIn();
     WaitSpinner(x + 35, 22);
 }
@@ -2312,14 +2632,14 @@ page1:
     FadeOutCustom(1);
 
     x = UnfoldTextFrame(0, 24, 38, "Instructions  Page One of Five", "Press PgDn for next.  ESC to Exit.");
-    DrawTextLine(x, 4,  " OBJECT OF GAME:");
-    DrawTextLine(x, 6,  " On a strange and dangerous planet,");
-    DrawTextLine(x, 8,  " Cosmo must find and rescue his");
-    DrawTextLine(x, 10, " parents.");
-    DrawTextLine(x, 13, " Cosmo, having seen big scary alien");
-    DrawTextLine(x, 15, " footprints, believes his parents");
-    DrawTextLine(x, 17, " have been captured and taken away");
-    DrawTextLine(x, 19, " to be eaten!");
+    DrawStaticTextLine(x, 4,  " OBJECT OF GAME:");
+    DrawStaticTextLine(x, 6,  " On a strange and dangerous planet,");
+    DrawStaticTextLine(x, 8,  " Cosmo must find and rescue his");
+    DrawStaticTextLine(x, 10, " parents.");
+    DrawStaticTextLine(x, 13, " Cosmo, having seen big scary alien");
+    DrawStaticTextLine(x, 15, " footprints, believes his parents");
+    DrawStaticTextLine(x, 17, " have been captured and taken away");
+    DrawStaticTextLine(x, 19, " to be eaten!");
     FadeInCustom(1);
 
     /* "Previous page" keys are no-ops here */
@@ -2332,13 +2652,13 @@ page2:
     FadeOutCustom(1);
 
     x = UnfoldTextFrame(0, 24, 38, "Instructions  Page Two of Five", "Press PgUp or PgDn.  Esc to Exit.");
-    DrawTextLine(x, 4,  " Cosmo has a very special ability:");
-    DrawTextLine(x, 6,  " He can use his suction hands to");
-    DrawTextLine(x, 8,  " climb up walls.");
-    DrawTextLine(x, 11, " Warning:  Some surfaces, such as");
-    DrawTextLine(x, 13, " ice, might be too slippery for");
-    DrawTextLine(x, 15, " Cosmo to cling on firmly.");
-    DrawTextLine(x, 20, "\xFD""011                                 \xFD""034");
+    DrawStaticTextLine(x, 4,  " Cosmo has a very special ability:");
+    DrawStaticTextLine(x, 6,  " He can use his suction hands to");
+    DrawStaticTextLine(x, 8,  " climb up walls.");
+    DrawStaticTextLine(x, 11, " Warning:  Some surfaces, such as");
+    DrawStaticTextLine(x, 13, " ice, might be too slippery for");
+    DrawStaticTextLine(x, 15, " Cosmo to cling on firmly.");
+    DrawStaticTextLine(x, 20, "\xFD""011                                 \xFD""034");
     FadeInCustom(1);
 
     scancode = WaitSpinner(x + 35, 22);
@@ -2349,14 +2669,14 @@ page3:
     FadeOutCustom(1);
 
     x = UnfoldTextFrame(0, 24, 38, "Instructions  Page Three of Five", "Press PgUp or PgDn.  Esc to Exit.");
-    DrawTextLine(x,     4,  " Cosmo can jump onto attacking");
-    DrawTextLine(x,     6,  " creatures without being harmed.");
-    DrawTextLine(x,     8,  " This is also Cosmo's way of");
-    DrawTextLine(x,     10, " defending himself.");
-    DrawTextLine(x,     13, " Cosmo can also find and use bombs.");
-    DrawTextLine(x + 5, 18, "   \xFD""036");
-    DrawTextLine(x + 5, 20, "         \xFD""024          \xFD""037");
-    DrawTextLine(x + 5, 20, "   \xFE""118000         \xFE""057000         \xFE""024000");
+    DrawStaticTextLine(x,     4,  " Cosmo can jump onto attacking");
+    DrawStaticTextLine(x,     6,  " creatures without being harmed.");
+    DrawStaticTextLine(x,     8,  " This is also Cosmo's way of");
+    DrawStaticTextLine(x,     10, " defending himself.");
+    DrawStaticTextLine(x,     13, " Cosmo can also find and use bombs.");
+    DrawStaticTextLine(x + 5, 18, "   \xFD""036");
+    DrawStaticTextLine(x + 5, 20, "         \xFD""024          \xFD""037");
+    DrawStaticTextLine(x + 5, 20, "   \xFE""118000         \xFE""057000         \xFE""024000");
     FadeInCustom(1);
 
     scancode = WaitSpinner(x + 35, 22);
@@ -2367,12 +2687,12 @@ page4:
     FadeOutCustom(1);
 
     x = UnfoldTextFrame(0, 24, 38, "Instructions  Page Four of Five", "Press PgUp or PgDn.  Esc to Exit.");
-    DrawTextLine(x,     5,  " Use the up and down arrow keys to");
-    DrawTextLine(x,     7,  " make Cosmo look up and down,");
-    DrawTextLine(x,     9,  " enabling him to see areas that");
-    DrawTextLine(x,     11, " might be off the screen.");
-    DrawTextLine(x + 4, 18, "   \xFD""028                  \xFD""029");
-    DrawTextLine(x,     19, "      Up Key           Down Key");
+    DrawStaticTextLine(x,     5,  " Use the up and down arrow keys to");
+    DrawStaticTextLine(x,     7,  " make Cosmo look up and down,");
+    DrawStaticTextLine(x,     9,  " enabling him to see areas that");
+    DrawStaticTextLine(x,     11, " might be off the screen.");
+    DrawStaticTextLine(x + 4, 18, "   \xFD""028                  \xFD""029");
+    DrawStaticTextLine(x,     19, "      Up Key           Down Key");
     FadeInCustom(1);
 
     scancode = WaitSpinner(x + 35, 22);
@@ -2382,14 +2702,14 @@ page4:
     FadeOutCustom(1);
 
     x = UnfoldTextFrame(0, 24, 38, "Instructions  Page Five of Five", "Press PgUp.  Esc to Exit.");
-    DrawTextLine(x, 5,  " In Cosmo's Cosmic Adventure, it's");
-    DrawTextLine(x, 7,  " up to you to discover the use of");
-    DrawTextLine(x, 9,  " all the neat and strange objects");
-    DrawTextLine(x, 11, " you'll encounter on your journey.");
-    DrawTextLine(x, 13, " Secret Hint Globes will help");
-    DrawTextLine(x, 15, " you along the way.");
-    DrawTextLine(x, 18, "                 \xFE""125000");
-    DrawTextLine(x, 20, "              \xFD""027   \xFE""125002");
+    DrawStaticTextLine(x, 5,  " In Cosmo's Cosmic Adventure, it's");
+    DrawStaticTextLine(x, 7,  " up to you to discover the use of");
+    DrawStaticTextLine(x, 9,  " all the neat and strange objects");
+    DrawStaticTextLine(x, 11, " you'll encounter on your journey.");
+    DrawStaticTextLine(x, 13, " Secret Hint Globes will help");
+    DrawStaticTextLine(x, 15, " you along the way.");
+    DrawStaticTextLine(x, 18, "                 \xFE""125000");
+    DrawStaticTextLine(x, 20, "              \xFD""027   \xFE""125002");
     FadeInCustom(1);
 
     scancode = WaitSpinner(x + 35, 22);
@@ -2902,20 +3222,77 @@ Display memory statistics for the game.
 - "Total Actors" is the *peak* number of actor slots that have been used since
   the current level (re)started. This does not decrease when actors die, nor
   does it increase when a new actor occupies a dead actor's slot.
+
+#ifdef MEMORY_ARENAS: "Take Up" and "Total Map Memory" are replaced by the
+number of bytes allocated from the process arena, and the most that any level
+has used of the level arena.
 */
 void ShowMemoryUsage(void)
 {
     word x = UnfoldTextFrame(2, 8, 30, "- Memory Usage -", "Press ANY key.");
     DrawTextLine(x + 6,  4, "Memory free:");
+#ifdef MEMORY_ARENAS
+    DrawTextLine(x + 4,  5, "Process Arena:");
+    DrawTextLine(x + 1,  6, "Level Arena Peak:");
+#else
     DrawTextLine(x + 10, 5, "Take Up:");
     DrawTextLine(x + 1,  6, "Total Map Memory:  65049");
+#endif  /* MEMORY_ARENAS */
     DrawTextLine(x + 5,  7, "Total Actors:");
     DrawNumberFlushRight(x + 24, 4, totalMemFreeAfter);
+#ifdef MEMORY_ARENAS
+    DrawNumberFlushRight(x + 24, 5, processArena.used);
+    DrawNumberFlushRight(x + 24, 6, levelArena.peak);
+#else
     DrawNumberFlushRight(x + 24, 5, totalMemFreeBefore);
+#endif  /* MEMORY_ARENAS */
     DrawNumberFlushRight(x + 24, 7, numActors);
     WaitSpinner(x + 27, 8);
 }
 
+#ifdef MEMORY_ARENAS
+/*
+Allocate `size` bytes from the passed arena, and return a pointer to them or
+NULL if there isn't enough memory. An arena without a `base` or a `size` gets
+each block from malloc(); otherwise blocks are carved out of `base` one after
+the other. Either way, the arena's usage and high-water mark are updated.
+*/
+void *ArenaAlloc(Arena *arena, word size)
+{
+    void *block;
+
+    if (arena->base == NULL) {
+        /* A fixed arena whose own memory couldn't be had gives out nothing */
+        block = arena->size == 0 ? malloc(size) : NULL;
+    } else {
+        /* Keep every block in a fixed arena word-aligned */
+        if (size % 2 != 0) size++;
+
+        if (arena->used + size <= arena->size) {
+            block = arena->base + (word)arena->used;
+        } else {
+            block = NULL;
+        }
+    }
+
+    if (block == NULL) return NULL;
+
+    arena->used += size;
+    if (arena->used > arena->peak) arena->peak = arena->used;
+
+    return block;
+}
+
+/*
+Give back everything allocated from the passed arena, in one go. This only makes
+sense for an arena with a `base`; blocks from malloc() stay allocated.
+*/
+void ResetArena(Arena *arena)
+{
+    arena->used = 0;
+}
+#endif  /* MEMORY_ARENAS */
+
 /*
 Display the Game Redefine menu and call the appropriate function based on the
 key pressed.
@@ -2958,6 +3335,9 @@ void ShowGameRedefineMenu(void)
 Attempt to load the configuration file specified by the filename. If the file
 does not exist, load the default configuration where arrow keys move, Ctrl
 jumps, and Alt bombs. This is where the default Simpsons high scores are set.
+
+#ifdef QUICK_JOYSTICK: A joystick calibration saved after the high scores is
+loaded too. This does not turn the joystick on.
 */
 void LoadConfigurationData(char *filename)
 {
@@ -3022,6 +3402,24 @@ void LoadConfigurationData(char *filename)
             fscanf(fp, "%[^\n]s", highScoreNames[i]);  /* fairly dangerous */
         }
 
+#ifdef QUICK_JOYSTICK
+        /* Older files end after the high scores, and get no calibration */
+        {
+            int left, right, top, bottom, btn1bombs;
+
+            if (fscanf(
+                fp, " JOY %d %d %d %d %d", &left, &right, &top, &bottom, &btn1bombs
+            ) == 5) {
+                joystickBandLeft[JOYSTICK_A] = left;
+                joystickBandRight[JOYSTICK_A] = right;
+                joystickBandTop[JOYSTICK_A] = top;
+                joystickBandBottom[JOYSTICK_A] = bottom;
+                joystickBtn1Bombs = btn1bombs != 0;
+                hasJoystickCalibration = true;
+            }
+        }
+
+#endif  /* QUICK_JOYSTICK */
         fclose(fp);
     }
 }
@@ -3029,6 +3427,9 @@ void LoadConfigurationData(char *filename)
 /*
 Save the current state of the global configuration variables to the
 configuration file specified by the fileneme.
+
+#ifdef QUICK_JOYSTICK: The joystick calibration is saved after the high scores,
+if there is one, even while the joystick is off. The original game ignores it.
 */
 void SaveConfigurationData(char *filename)
 {
@@ -3052,6 +3453,16 @@ void SaveConfigurationData(char *filename)
         fprintf(fp, "%s\n", highScoreNames[i]);
     }
 
+#ifdef QUICK_JOYSTICK
+    if (hasJoystickCalibration) {
+        fprintf(fp, "JOY %d %d %d %d %d\n",
+            joystickBandLeft[JOYSTICK_A], joystickBandRight[JOYSTICK_A],
+            joystickBandTop[JOYSTICK_A], joystickBandBottom[JOYSTICK_A],
+            joystickBtn1Bombs ? 1 : 0
+        );
+    }
+
+#endif  /* QUICK_JOYSTICK */
     fclose(fp);
 }
 
@@ -3271,119 +3682,119 @@ void ShowHintGlobeMessage(word hint_num)
     /* Ep 1 has some considerably longer hints that need a bigger frame */
     if (hint_num != 0 && hint_num < 15) {
         x = UnfoldTextFrame(2, 9, 28, "COSMIC HINT!", "Press any key to exit.");
-        DrawTextLine(x, 8, " Press SPACE to hurry or");
+        DrawStaticTextLine(x, 8, " Press SPACE to hurry or");
     }
 
     switch (hint_num) {
     case 0:
         x = UnfoldTextFrame(2, 11, 28, "COSMIC HINT!", "Press any key to exit.");
-        DrawTextLine(x, 10, " Press SPACE to hurry or");
-        DrawTextLine(x, 5, "\xFC""003 These hint globes will");
-        DrawTextLine(x, 6, "\xFC""003 help you along your");
-        DrawTextLine(x, 7, "\xFC""003 journey.  Press the up");
-        DrawTextLine(x, 8, "\xFC""003 key to reread them.");
+        DrawStaticTextLine(x, 10, " Press SPACE to hurry or");
+        DrawStaticTextLine(x, 5, "\xFC""003 These hint globes will");
+        DrawStaticTextLine(x, 6, "\xFC""003 help you along your");
+        DrawStaticTextLine(x, 7, "\xFC""003 journey.  Press the up");
+        DrawStaticTextLine(x, 8, "\xFC""003 key to reread them.");
         WaitSpinner(x + 25, 11);
         break;
 
     case 1:
-        DrawTextLine(x, 5, "\xFC""003 Bump head into switch");
-        DrawTextLine(x, 6, "\xFC""003 above!");
+        DrawStaticTextLine(x, 5, "\xFC""003 Bump head into switch");
+        DrawStaticTextLine(x, 6, "\xFC""003 above!");
         break;
 
     case 2:
-        DrawTextLine(x, 5, "\xFC""003 The ice in this cave is");
-        DrawTextLine(x, 6, "\xFC""003 very, very slippery.");
+        DrawStaticTextLine(x, 5, "\xFC""003 The ice in this cave is");
+        DrawStaticTextLine(x, 6, "\xFC""003 very, very slippery.");
         break;
 
     case 3:
-        DrawTextLine(x, 5, "\xFC""003 Use this shield for");
-        DrawTextLine(x, 6, "\xFC""003 temporary invincibility.");
+        DrawStaticTextLine(x, 5, "\xFC""003 Use this shield for");
+        DrawStaticTextLine(x, 6, "\xFC""003 temporary invincibility.");
         break;
 
     case 4:
-        DrawTextLine(x, 5, "\xFC""003 You found a secret");
-        DrawTextLine(x, 6, "\xFC""003 area!!!  Good job!");
+        DrawStaticTextLine(x, 5, "\xFC""003 You found a secret");
+        DrawStaticTextLine(x, 6, "\xFC""003 area!!!  Good job!");
         break;
 
     case 5:
-        DrawTextLine(x, 5, "\xFC""003 In high places look up");
-        DrawTextLine(x, 6, "\xFC""003 to find bonus objects.");
+        DrawStaticTextLine(x, 5, "\xFC""003 In high places look up");
+        DrawStaticTextLine(x, 6, "\xFC""003 to find bonus objects.");
         break;
 
     case 6:
-        DrawTextLine(x, 5, "\xFC""003      Out of Order...");
+        DrawStaticTextLine(x, 5, "\xFC""003      Out of Order...");
         break;
 
     case 7:
-        DrawTextLine(x, 5, "\xFC""003 This might be a good");
-        DrawTextLine(x, 6, "\xFC""003 time to save your game!");
+        DrawStaticTextLine(x, 5, "\xFC""003 This might be a good");
+        DrawStaticTextLine(x, 6, "\xFC""003 time to save your game!");
         break;
 
     case 8:
-        DrawTextLine(x, 5, "\xFC""003 Press your up key to");
-        DrawTextLine(x, 6, "\xFC""003 use the transporter.");
+        DrawStaticTextLine(x, 5, "\xFC""003 Press your up key to");
+        DrawStaticTextLine(x, 6, "\xFC""003 use the transporter.");
         break;
 
     case 9:
-        DrawTextLine(x, 5, "\xFC""003  (1) FOR...");
+        DrawStaticTextLine(x, 5, "\xFC""003  (1) FOR...");
         break;
 
     case 10:
-        DrawTextLine(x, 5, "\xFC""003  (2) EXTRA...");
+        DrawStaticTextLine(x, 5, "\xFC""003  (2) EXTRA...");
         break;
 
     case 11:
-        DrawTextLine(x, 5, "\xFC""003  (3) POINTS,...");
+        DrawStaticTextLine(x, 5, "\xFC""003  (3) POINTS,...");
         break;
 
     case 12:
-        DrawTextLine(x, 5, "\xFC""003  (4) DESTROY...");
+        DrawStaticTextLine(x, 5, "\xFC""003  (4) DESTROY...");
         break;
 
     case 13:
-        DrawTextLine(x, 5, "\xFC""003  (5) HINT...");
+        DrawStaticTextLine(x, 5, "\xFC""003  (5) HINT...");
         break;
 
     case 14:
-        DrawTextLine(x, 5, "\xFC""003  (6) GLOBES!!!");
+        DrawStaticTextLine(x, 5, "\xFC""003  (6) GLOBES!!!");
         break;
 
     case 15:
         x = UnfoldTextFrame(2, 11, 28, "COSMIC HINT!", "Press any key to exit.");
-        DrawTextLine(x + 22, 8, "\xFE""083000");
-        DrawTextLine(x, 10, " Press SPACE to hurry or");
-        DrawTextLine(x, 5, "\xFC""003  The Clam Plants won't");
-        DrawTextLine(x, 6, "\xFC""003  hurt you if their");
-        DrawTextLine(x, 7, "\xFC""003  mouths are closed.");
+        DrawStaticTextLine(x + 22, 8, "\xFE""083000");
+        DrawStaticTextLine(x, 10, " Press SPACE to hurry or");
+        DrawStaticTextLine(x, 5, "\xFC""003  The Clam Plants won't");
+        DrawStaticTextLine(x, 6, "\xFC""003  hurt you if their");
+        DrawStaticTextLine(x, 7, "\xFC""003  mouths are closed.");
         WaitSpinner(x + 25, 11);
         break;
 
     case 16:
         x = UnfoldTextFrame(2, 10, 28, "COSMIC HINT!", "Press any key to exit.");
-        DrawTextLine(x, 9, " Press SPACE to hurry or");
-        DrawTextLine(x + 23, 7, "\xFE""001002");
-        DrawTextLine(x, 5, "\xFC""003  Collect the STARS to");
-        DrawTextLine(x, 6, "\xFC""003  advance to BONUS");
-        DrawTextLine(x, 7, "\xFC""003  STAGES.");
+        DrawStaticTextLine(x, 9, " Press SPACE to hurry or");
+        DrawStaticTextLine(x + 23, 7, "\xFE""001002");
+        DrawStaticTextLine(x, 5, "\xFC""003  Collect the STARS to");
+        DrawStaticTextLine(x, 6, "\xFC""003  advance to BONUS");
+        DrawStaticTextLine(x, 7, "\xFC""003  STAGES.");
         WaitSpinner(x + 25, 10);
         break;
 
     case 17:
         x = UnfoldTextFrame(2, 10, 28, "COSMIC HINT!", "Press any key to exit.");
-        DrawTextLine(x, 9, " Press SPACE to hurry or");
-        DrawTextLine(x, 5, "\xFC""003  Some creatures require");
-        DrawTextLine(x, 6, "\xFC""003  more than one pounce");
-        DrawTextLine(x, 7, "\xFC""003  to defeat!");
+        DrawStaticTextLine(x, 9, " Press SPACE to hurry or");
+        DrawStaticTextLine(x, 5, "\xFC""003  Some creatures require");
+        DrawStaticTextLine(x, 6, "\xFC""003  more than one pounce");
+        DrawStaticTextLine(x, 7, "\xFC""003  to defeat!");
         WaitSpinner(x + 25, 10);
         break;
 
     case 18:
         x = UnfoldTextFrame(2, 9, 30, "COSMIC HINT!", "Press any key to exit.");
-        DrawTextLine(x + 25, 8, "\xFD""032");
-        DrawTextLine(x, 8, "  Press SPACE to hurry or");
+        DrawStaticTextLine(x + 25, 8, "\xFD""032");
+        DrawStaticTextLine(x, 8, "  Press SPACE to hurry or");
         /* Incorrect possessive form preserved faithfully */
-        DrawTextLine(x, 5, "\xFC""003 Cosmo can climb wall's");
-        DrawTextLine(x, 6, "\xFC""003 with his suction hands.");
+        DrawStaticTextLine(x, 5, "\xFC""003 Cosmo can climb wall's");
+        DrawStaticTextLine(x, 6, "\xFC""003 with his suction hands.");
         WaitSpinner(x + 27, 9);
         break;
     }
@@ -3393,78 +3804,78 @@ void ShowHintGlobeMessage(word hint_num)
     }
 #elif EPISODE == 2
     x = UnfoldTextFrame(2, 9, 28, "COSMIC HINT!", "Press any key to exit.");
-    DrawTextLine(x, 8, " Press SPACE to hurry or");
+    DrawStaticTextLine(x, 8, " Press SPACE to hurry or");
 
     switch (hint_num) {
     case 0:
-        DrawTextLine(x, 5, "\xFC""003 Look out for enemies");
-        DrawTextLine(x, 6, "\xFC""003 from above!");
+        DrawStaticTextLine(x, 5, "\xFC""003 Look out for enemies");
+        DrawStaticTextLine(x, 6, "\xFC""003 from above!");
         break;
 
     case 1:
-        DrawTextLine(x, 5, "\xFC""003    Don't...");
+        DrawStaticTextLine(x, 5, "\xFC""003    Don't...");
         break;
 
     case 2:
-        DrawTextLine(x, 5, "\xFC""003    step...");
+        DrawStaticTextLine(x, 5, "\xFC""003    step...");
         break;
 
     case 3:
-        DrawTextLine(x, 5, "\xFC""003    on...");
+        DrawStaticTextLine(x, 5, "\xFC""003    on...");
         break;
 
     case 4:
-        DrawTextLine(x, 5, "\xFC""003    worms...");
+        DrawStaticTextLine(x, 5, "\xFC""003    worms...");
         break;
 
     case 5:
-        DrawTextLine(x, 5, "\xFC""003 There is a secret area");
-        DrawTextLine(x, 6, "\xFC""003 in this level!");
+        DrawStaticTextLine(x, 5, "\xFC""003 There is a secret area");
+        DrawStaticTextLine(x, 6, "\xFC""003 in this level!");
         break;
 
     case 6:
-        DrawTextLine(x, 5, "\xFC""003 You found the secret");
-        DrawTextLine(x, 6, "\xFC""003 area.  Well done.");
+        DrawStaticTextLine(x, 5, "\xFC""003 You found the secret");
+        DrawStaticTextLine(x, 6, "\xFC""003 area.  Well done.");
         break;
 
     case 7:
-        DrawTextLine(x, 5, "\xFC""003    Out of order.");
+        DrawStaticTextLine(x, 5, "\xFC""003    Out of order.");
         break;
     }
 
     WaitSpinner(x + 25, 9);
 #elif EPISODE == 3
     x = UnfoldTextFrame(2, 9, 28, "COSMIC HINT!", "Press any key to exit.");
-    DrawTextLine(x, 8, " Press SPACE to hurry or");
+    DrawStaticTextLine(x, 8, " Press SPACE to hurry or");
 
     switch (hint_num) {
     case 0:
-        DrawTextLine(x, 5, "\xFC""003 Did you find the");
-        DrawTextLine(x, 6, "\xFC""003 hamburger in this level?");
+        DrawStaticTextLine(x, 5, "\xFC""003 Did you find the");
+        DrawStaticTextLine(x, 6, "\xFC""003 hamburger in this level?");
         break;
 
     case 1:
-        DrawTextLine(x, 5, "\xFC""003 This hint globe being");
-        DrawTextLine(x, 6, "\xFC""003 upgraded to a 80986.");
+        DrawStaticTextLine(x, 5, "\xFC""003 This hint globe being");
+        DrawStaticTextLine(x, 6, "\xFC""003 upgraded to a 80986.");
         break;
 
     case 2:
-        DrawTextLine(x, 5, "\xFC""003 WARNING:  Robots shoot");
-        DrawTextLine(x, 6, "\xFC""003 when the lights are on!");
+        DrawStaticTextLine(x, 5, "\xFC""003 WARNING:  Robots shoot");
+        DrawStaticTextLine(x, 6, "\xFC""003 when the lights are on!");
         break;
 
     case 3:
-        DrawTextLine(x, 5, "\xFC""003 There is a hidden scooter");
-        DrawTextLine(x, 6, "\xFC""003 in this level.");
+        DrawStaticTextLine(x, 5, "\xFC""003 There is a hidden scooter");
+        DrawStaticTextLine(x, 6, "\xFC""003 in this level.");
         break;
 
     case 4:
-        DrawTextLine(x, 5, "\xFC""003 Did you find the");
-        DrawTextLine(x, 6, "\xFC""003 hamburger in level 8!");
+        DrawStaticTextLine(x, 5, "\xFC""003 Did you find the");
+        DrawStaticTextLine(x, 6, "\xFC""003 hamburger in level 8!");
         break;
 
     case 5:
-        DrawTextLine(x, 5, "\xFC""003   Out of order...!");
+        DrawStaticTextLine(x, 5, "\xFC""003   Out of order...!");
         break;
     }
 
@@ -3607,6 +4018,11 @@ void DrawStaticGameScreen(void)
     UpdateStars();
     UpdateBombs();
     UpdateHealth();
+
+#if defined(LAZY_STATUS_BAR) && !defined(DEBUG_BAR)
+    /* The numbers were just covered up; the next flush redraws all of them */
+    isStatusBarDrawn = false;
+#endif  /* LAZY_STATUS_BAR && !DEBUG_BAR */
 }
 
 /*
@@ -40,12 +40,284 @@ standing on the safety net, the jump command will allow long-jumping out.
 /* Enable this to add vanity text inside the game */
 /*#define VANITY*/
 
+/*
+Enable this to keep CARTOON.MNI in a buffer of its own once it has been read,
+instead of borrowing (and clobbering) the map data area every time.
+*/
+/*#define CARTOON_CACHE*/
+
+/*
+Enable this to keep up to this many of the 320x200 fullscreen images in memory
+of their own (32,000 bytes each, least recently used goes first), so the title
+and credits cycle stops rereading them from the group file.
+*/
+/*#define FULLSCREEN_CACHE 2*/
+
+/*
+Enable this to draw text lines by first compiling their markup into a list of
+commands, which can also be kept and redrawn without parsing the text again.
+The story, instruction, and hint globe text is compiled the first time it is
+shown, and kept for every time after that.
+*/
+/*#define TEXT_LAYOUT*/
+
+/*
+Enable this to clip each sprite to the game window once, then draw only its
+visible tiles using a cached table of the in-front map cells on screen.
+*/
+/*#define SPRITE_CLIP*/
+
+/*
+Enable this to record demos in a compressed format that is written to disk as
+the game is played, with no length limit. Old-style demos still play back.
+*/
+/*#define DEMO_STREAM*/
+
+/*
+Enable this (along with DEMO_STREAM) to record a hash of the game state into
+demos every this many ticks. Playback writes a report to DESYNC.TXT describing
+the first place where the state doesn't match what was recorded.
+*/
+/*#define DEMO_DESYNC_CHECK 10*/
+
+/*
+Enable this to keep every source of randomness (GameRand(), the C library's
+rand()/random(), and the shard movement mode) in one `randomState` structure
+that can be seeded, copied and restored. Unseeded, it produces the same
+sequences as the original game.
+*/
+/*#define RNG_CONTEXT*/
+
+/*
+Enable this (along with RNG_CONTEXT) to build a program that runs a fixed set
+of workloads for this many ticks each, as fast as the machine allows, then
+writes the timings to BENCH.JSN and exits instead of showing the title screen.
+Ticks are timed off the timer chip's counter, to a little under a microsecond.
+*/
+/*#define BENCHMARK 300*/
+
+/*
+Enable this (along with DEMO_DESYNC_CHECK and RNG_CONTEXT) to build a program
+that searches for a route through each map, looking this many decisions ahead,
+and writes each route it finds as a demo (TASnn.MNI) with a summary in TAS.JSN.
+*/
+/*#define TAS_SEARCH 2*/
+
+/*
+Enable this to build a program that works out which positions the player could
+reach in each map (following the same movement rules as the game), writes each
+map's positions to REACHnn.TXT with a summary in REACH.JSN, and exits.
+*/
+/*#define REACHABILITY*/
+
+/*
+Enable this to allow maps taller than the original 64K limit. The map cells are
+kept in a swap file, and only as many pages (this many rows each) as fit in the
+original map memory are paged in at a time: a window of them around the game
+window, and a few single pages in use elsewhere, like under moving platforms.
+The height of a map is worked out from the size of its group entry. Only maps up
+to 256 tiles wide can be paged.
+
+Collision tests walk upward from a sprite's bottom row as far as its height, and
+only the page right above each page in memory is sure to be there, so pages have
+to be at least 16 rows tall.
+*/
+/*#define MAP_PAGING 16*/
+
+/*
+Enable this to queue key presses and releases along with the time they happened,
+so a key tapped and released between two game ticks still counts on the next
+one. The queue holds this many events, and only fills during play. The time from
+a movement key press until the frame that uses it is shown is measured, with a
+histogram going to LATENCY.JSN on exit.
+*/
+/*#define INPUT_EVENTS 32*/
+
+/*
+Enable this (along with DEMO_STREAM) to build a program that plays back each
+demo listed in TRACE.LST as fast as possible, and compares the player, actor,
+and counter variables on every tick against the demo's golden trace (.TRC). A
+demo without a golden trace gets one recorded. The results go in TRACE.JSN.
+*/
+/*#define GOLDEN_TRACE*/
+
+/*
+Enable this (along with DEMO_DESYNC_CHECK and RNG_CONTEXT) to relay each game
+played on this computer through the serial port with this number (1 or 2) to
+another computer running the same build. Pressing W at the main menu on that
+computer watches the next game to start, checking the state hashes as it goes.
+*/
+/*#define SPECTATOR_RELAY 1*/
+
+/*
+Enable this to keep an image of each level as it stood right after loading, so
+that the level restarts from memory when the player dies instead of being read
+back from the group file and the temporary save file. Map changes are journaled
+rather than copying the whole map; if the journal fills up, or something else
+gets loaded over the map, the level is reloaded the original way.
+*/
+/*#define LEVEL_RESTART*/
+
+/*
+Enable this to have F9 step the game speed through normal, this many times
+normal, and as fast as the computer can go. Everything paced by the game clock
+(the game loop, delays, fades, and the death animations) follows along. The
+speed goes back to normal whenever a game ends. With SPECTATOR_RELAY, a game
+being relayed can't be sped up.
+*/
+/*#define FAST_FORWARD 4*/
+
+/*
+Enable this to collect the status bar changes made during each frame and draw
+them all at once, right before the video pages are flipped. A burst of pickups
+or pounces within the same frame then costs one redraw, and only the digits and
+health cells that actually changed get drawn.
+*/
+/*#define LAZY_STATUS_BAR*/
+
+/*
+Enable this to look up which sprite types can be destroyed by explosions, and
+which ones react to the player, in a table built from one list of properties
+instead of long switch statements. Actors that can't interact with the player
+are then turned away before any of the position tests are done.
+*/
+/*#define SPRITE_FLAGS*/
+
+/*
+Enable this to keep a log of the map cells that change during each game tick,
+holding up to this many changes along with the cell values before and after.
+Code that keeps something derived from the map can then update just the cells
+that changed, instead of going over the whole map. With DEMO_DESYNC_CHECK, the
+map hash is kept up to date this way.
+*/
+/*#define MAP_CHANGE_LOG 256*/
+
+/*
+Enable this to account for memory in arenas. Everything that stays allocated
+until the program exits is counted in the process arena, and things that only
+last for one level come out of a level arena of this many bytes (65,535 at
+most), which is emptied whenever a new level starts. The level arena is only
+set aside if something uses it (LEVEL_RESTART). The memory usage screen shows
+how much each arena has used.
+*/
+/*#define MEMORY_ARENAS 32768U*/
+
+/*
+Enable this to build a program that is driven by a learning agent (or any other
+program) through the serial port with this number (1 or 2), at 115,200 baud. The
+agent resets the game to a level and steps it one tick at a time with the same
+command bits that demos use, getting back the score, health, player position,
+and whether the level was won or the player died after each step. Nothing is
+drawn and there is no waiting between ticks. Many instances of the game can be
+run side by side this way, each with a port of its own.
+*/
+/*#define AGENT_SERVER 1*/
+
+/*
+Enable this (along with AGENT_SERVER and SPRITE_FLAGS) to let the agent ask for
+the game window as a grid of cells instead of pixels. Each cell has the solidity
+and other attributes of its map tile, along with bits saying whether the player
+or any actor covers it, and whether one of those actors hurts or is a prize.
+*/
+/*#define TILE_GRID*/
+
+/*
+Enable this to hold off after each page flip in the game loop until the video
+adapter has started its next vertical retrace. The new page only goes up on the
+screen at that point, so nothing gets drawn over the old page while it is still
+being shown. This only costs time when a frame runs long enough to need it.
+*/
+/*#define RETRACE_FLIP*/
+
+/*
+Enable this to stop timing each joystick axis once it is clear which way the
+stick is pushed, instead of waiting for the game port to finish counting every
+frame. The joystick calibration is also kept in the configuration file, so it
+doesn't have to be redone every time the game starts. The saved calibration is
+only put to use if a joystick is plugged in at startup.
+*/
+/*#define QUICK_JOYSTICK*/
+
+#if defined(DEMO_DESYNC_CHECK) && !defined(DEMO_STREAM)
+#   error "DEMO_DESYNC_CHECK requires DEMO_STREAM"
+#endif
+
+#if defined(BENCHMARK) && !defined(RNG_CONTEXT)
+#   error "BENCHMARK requires RNG_CONTEXT"
+#endif
+
+#if defined(TAS_SEARCH) && !(defined(DEMO_DESYNC_CHECK) && defined(RNG_CONTEXT))
+#   error "TAS_SEARCH requires DEMO_DESYNC_CHECK and RNG_CONTEXT"
+#endif
+
+#if defined(GOLDEN_TRACE) && !defined(DEMO_STREAM)
+#   error "GOLDEN_TRACE requires DEMO_STREAM"
+#endif
+
+#if defined(SPECTATOR_RELAY) && !(defined(DEMO_DESYNC_CHECK) && defined(RNG_CONTEXT))
+#   error "SPECTATOR_RELAY requires DEMO_DESYNC_CHECK and RNG_CONTEXT"
+#endif
+
+#if defined(SPECTATOR_RELAY) && defined(AGENT_SERVER)
+#   error "SPECTATOR_RELAY can't be used with AGENT_SERVER"
+#endif
+
+#if defined(TILE_GRID) && !(defined(AGENT_SERVER) && defined(SPRITE_FLAGS))
+#   error "TILE_GRID requires AGENT_SERVER and SPRITE_FLAGS"
+#endif
+
+#if defined(MAP_PAGING) && MAP_PAGING < 16
+#   error "MAP_PAGING must be at least 16"
+#endif
+
+#if defined(MAP_PAGING) && \
+    (defined(DEMO_DESYNC_CHECK) || defined(REACHABILITY) || defined(LEVEL_RESTART))
+#   error "MAP_PAGING can't be used with DEMO_DESYNC_CHECK, REACHABILITY, or LEVEL_RESTART"
+#endif
+
+/* Both of these need a count of timer interrupts */
+#if defined(BENCHMARK) || defined(INPUT_EVENTS)
+#   define HAS_INTERRUPT_CLOCK
+#endif
+
+/* All of these need every tick to start from the same state on each run */
+#if defined(BENCHMARK) || defined(TAS_SEARCH) || defined(SPECTATOR_RELAY)
+#   define HAS_TICK_STATICS
+#endif
+
+/* Both of these talk to another program through a serial port */
+#if defined(SPECTATOR_RELAY) || defined(AGENT_SERVER)
+#   define HAS_SERIAL_PORT
+#endif
+
+/* Both of these step the game one tick at a time, with commands they choose */
+#if defined(TAS_SEARCH) || defined(AGENT_SERVER)
+#   define HAS_TICK_STEPPER
+#endif
+
+/* Both of these roll the map back by undoing the changes made to it */
+#if defined(TAS_SEARCH) || defined(LEVEL_RESTART)
+#   define HAS_MAP_JOURNAL
+#endif
+
+/* All of these can run the game clock faster than normal */
+#if defined(BENCHMARK) || defined(TAS_SEARCH) || defined(GOLDEN_TRACE) || \
+    defined(FAST_FORWARD) || defined(AGENT_SERVER)
+#   define HAS_VIRTUAL_CLOCK
+#endif
+
+/* All of these run the game without a player, and without drawing at times */
+#if defined(BENCHMARK) || defined(TAS_SEARCH) || defined(REACHABILITY) || \
+    defined(GOLDEN_TRACE) || defined(AGENT_SERVER)
+#   define HAS_HEADLESS_MODE
+#endif
+
 #define GAME_VERSION "1.20"
 
 #include <alloc.h>  /* for coreleft() only */
 #include <conio.h>
 #include <dos.h>
-#include <io.h>  /* for filelength() only */
+#include <io.h>  /* for filelength() only (plus close()/dup() with DEMO_STREAM) */
 #include <mem.h>  /* for movmem() only */
 #include <stdio.h>
 #include <stdlib.h>
@@ -140,6 +412,48 @@ typedef struct {
     word actor, x, y, age;
 } Spawner;
 
+#ifdef RNG_CONTEXT
+typedef struct {
+    dword seed;  /* rand()/random(); same generator as the Borland C library */
+    word stepcount;  /* GameRand() */
+    word shardxmode;  /* NewShard() */
+} RandomState;
+#endif  /* RNG_CONTEXT */
+
+#ifdef TEXT_LAYOUT
+#define TEXT_LAYOUT_MAX 24
+#define TEXT_LAYOUT_KEPT_LINES 128  /* static text lines kept compiled */
+#define TEXT_LAYOUT_KEPT_CMDS 768  /* commands shared by all of those lines */
+
+typedef struct {
+    byte type, col;
+    word arg1, arg2;  /* glyph count/frame/delay, sprite frame */
+    char *text;  /* first glyph, only for TEXT_CMD_GLYPHS */
+} TextCommand;
+
+typedef struct {
+    word count;
+    word endcol;  /* where a continuation of this text line begins */
+    TextCommand commands[TEXT_LAYOUT_MAX];
+} TextLayout;
+
+typedef struct {
+    word delay, delayleft;
+} TextPacing;
+#endif  /* TEXT_LAYOUT */
+
+#ifdef MEMORY_ARENAS
+typedef struct {
+    byte *base;  /* NULL if each allocation comes from malloc() */
+    word size;  /* nonzero without a `base` if that couldn't be allocated */
+    dword used, peak;
+} Arena;
+
+#   define PROCESS_MALLOC(size) ArenaAlloc(&processArena, (size))
+#else
+#   define PROCESS_MALLOC(size) malloc(size)
+#endif  /* MEMORY_ARENAS */
+
 extern bbool isInGame;
 extern bool winGame;
 extern dword gameScore, gameStars;
@@ -160,16 +474,39 @@ extern byte lastScancode;
 extern bbool isKeyDown[];
 extern bool isJoystickReady;
 extern bbool cmdWest, cmdEast, cmdNorth, cmdSouth, cmdJump, cmdBomb;
+#ifdef INPUT_EVENTS
+extern bbool wasDialogShown;
+#endif  /* INPUT_EVENTS */
 extern bool isMusicEnabled, isSoundEnabled;
 extern byte scancodeWest, scancodeEast, scancodeNorth, scancodeSouth, scancodeJump, scancodeBomb;
 extern Music *activeMusic;
 extern word numActors;
+#ifdef RNG_CONTEXT
+extern RandomState randomState;
+#endif  /* RNG_CONTEXT */
+#ifdef HAS_VIRTUAL_CLOCK
+extern bbool isClockUnthrottled;
+#endif  /* HAS_VIRTUAL_CLOCK */
+#ifdef MEMORY_ARENAS
+extern Arena processArena, levelArena;
+#endif  /* MEMORY_ARENAS */
 
 void DrawTextLine(word x_origin, word y_origin, char *text);
+#ifdef TEXT_LAYOUT
+char *CompileTextLine(char *text, word start_col, TextLayout *layout);
+void DrawTextLayout(word x_origin, word y_origin, TextLayout *layout, TextPacing *pacing);
+void DrawStaticTextLine(word x_origin, word y_origin, char *text);
+#else
+#   define DrawStaticTextLine DrawTextLine
+#endif  /* TEXT_LAYOUT */
 void DrawFullscreenImage(word image_num);
 void StartSound(word sound_num);
 void PCSpeakerService(void);
 void ShowStarBonus(void);
+#ifdef RNG_CONTEXT
+int NextRandom(void);
+void SeedRandomState(dword seed);
+#endif  /* RNG_CONTEXT */
 void InnerMain(int argc, char *argv[]);
 
 /*****************************************************************************
@@ -185,6 +522,16 @@ typedef struct {
 
 extern word yOffsetTable[];
 extern bbool isAdLibPresent;
+#ifdef HAS_INTERRUPT_CLOCK
+extern dword interruptClock;
+extern word interruptClockRate;
+#endif  /* HAS_INTERRUPT_CLOCK */
+#ifdef BENCHMARK
+dword ReadPreciseClock(void);
+#endif  /* BENCHMARK */
+#ifdef QUICK_JOYSTICK
+bool IsJoystickCalibrationUsable(void);
+#endif  /* QUICK_JOYSTICK */
 
 void StartAdLib(void);
 void StopAdLib(void);
@@ -204,6 +551,9 @@ void AddScore(dword points);
 void UpdateStars(void);
 void UpdateBombs(void);
 void UpdateHealth(void);
+#ifdef LAZY_STATUS_BAR
+void FlushStatusBar(void);
+#endif  /* LAZY_STATUS_BAR */
 void ShowHighScoreTable(void);
 void CheckHighScoreAndShow(void);
 FILE *GroupEntryFp(char *entry_name);
@@ -232,6 +582,10 @@ void ToggleMusic(void);
 void ShowPauseMessage(void);
 void ToggleGodMode(void);
 void ShowMemoryUsage(void);
+#ifdef MEMORY_ARENAS
+void *ArenaAlloc(Arena *arena, word size);
+void ResetArena(Arena *arena);
+#endif  /* MEMORY_ARENAS */
 void ShowGameRedefineMenu(void);
 void LoadConfigurationData(char *filename);
 void SaveConfigurationData(char *filename);